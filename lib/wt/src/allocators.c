@@ -303,9 +303,9 @@ void *wt_buddy_alloc(wt_buddy_t *b, usize size)
     {
       found->is_free = 0;
       res = (void *)((char *)found + b->align);
+      memset(res, 0, size);
     }
   }
-  memset(res, 0, size);
   return res;
 }
 
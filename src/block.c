@@ -1,12 +1,39 @@
 #include "block.h"
 #include "game.h"
 #include "memory.h"
+#include <string.h>
+
+#define BLOCK_ATLAS_INDEX(x, y) ((x) + (y) * 16)
+
+#define BLOCK_INFO(id, name_, top_x, top_y, bottom_x, bottom_y, side_x, side_y, solid_, light_) \
+  { .name = name_, \
+    .atlas_tiles = { { top_x, top_y }, { bottom_x, bottom_y }, { side_x, side_y }, \
+      { side_x, side_y }, { side_x, side_y }, { side_x, side_y } }, \
+    .solid = solid_, .light = light_ },
+
+#define BLOCK_FLAGS(id, name, top_x, top_y, bottom_x, bottom_y, side_x, side_y, solid, light) \
+  ((solid) ? BLOCK_FLAG_SOLID | BLOCK_FLAG_OPAQUE : BLOCK_FLAG_TRANSPARENT) | \
+  (BLOCK_IS_FLUID(BLOCK_##id) ? BLOCK_FLAG_FLUID : 0),
+
+#define BLOCK_FACE_TILES(id, name, top_x, top_y, bottom_x, bottom_y, side_x, side_y, solid, light) \
+  { BLOCK_ATLAS_INDEX(top_x, top_y), BLOCK_ATLAS_INDEX(bottom_x, bottom_y), \
+    BLOCK_ATLAS_INDEX(side_x, side_y), BLOCK_ATLAS_INDEX(side_x, side_y), \
+    BLOCK_ATLAS_INDEX(side_x, side_y), BLOCK_ATLAS_INDEX(side_x, side_y) },
+
+// the built in blocks and their hot tables are all worked out at compile time, registering them
+// is just a copy
+static const block_info_t k_builtin_infos[BLOCK_MAX] = { BLOCK_BUILTINS(BLOCK_INFO) };
+static const u8 k_builtin_flags[BLOCK_MAX] = { BLOCK_BUILTINS(BLOCK_FLAGS) };
+static const block_face_tiles_t k_builtin_face_tiles[BLOCK_MAX] = { BLOCK_BUILTINS(BLOCK_FACE_TILES) };
 
 typedef struct
 {
 //  wt_hashmap_t block_table;
   block_info_t block_table[BLOCK_MAX_COUNT];
   usize num_blocks;
+
+  u8 flags[BLOCK_MAX_COUNT];
+  block_face_tiles_t face_tiles[BLOCK_MAX_COUNT];
 } block_state_t;
 
 static block_state_t *get_state(void)
@@ -18,9 +45,14 @@ void block_mgr_init(void)
 {
   game_state_t *gs = game_get_state();
   block_state_t *s = gs->modules.block = mem_hunk_push(sizeof(block_state_t));
-  
+
 //  usize buffer_size = wt_hashmap_buffer_size(sizeof(block_info_t), BLOCK_MAX_COUNT);
 //  s->block_table = wt_hashmap_new(mem_hunk_push(buffer_size), buffer_size, sizeof(block_info_t));
+
+  memcpy(s->block_table, k_builtin_infos, sizeof(k_builtin_infos));
+  memcpy(s->flags, k_builtin_flags, sizeof(k_builtin_flags));
+  memcpy(s->face_tiles, k_builtin_face_tiles, sizeof(k_builtin_face_tiles));
+  s->num_blocks = BLOCK_MAX;
 }
 
 block_id_t block_new(block_info_t *info)
@@ -28,8 +60,15 @@ block_id_t block_new(block_info_t *info)
   block_state_t *s = get_state();
 //  u64 key = wt_hash_u32(info->name, BLOCK_NAME_LEN);
 //  wt_hashmap_insert(&s->block_table, key, info);
-  s->block_table[s->num_blocks++] = *info;
-  return s->num_blocks - 1;
+  block_id_t id = s->num_blocks++;
+  s->block_table[id] = *info;
+
+  s->flags[id] = info->solid ? BLOCK_FLAG_SOLID | BLOCK_FLAG_OPAQUE : BLOCK_FLAG_TRANSPARENT;
+  for (usize i = 0; i < 6; ++i)
+  {
+    s->face_tiles[id][i] = BLOCK_ATLAS_INDEX(info->atlas_tiles[i].x, info->atlas_tiles[i].y);
+  }
+  return id;
 }
 
 block_info_t *block_get_info(block_id_t id)
@@ -39,3 +78,13 @@ block_info_t *block_get_info(block_id_t id)
 //  if (id < s->num_blocks)
   return &s->block_table[id];
 }
+
+const u8 *block_get_flags(void)
+{
+  return get_state()->flags;
+}
+
+const block_face_tiles_t *block_get_face_tiles(void)
+{
+  return get_state()->face_tiles;
+}
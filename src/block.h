@@ -8,30 +8,72 @@
 
 typedef u32 block_id_t;
 
-// todo: either generate this or get rid of it
+// the blocks the game comes with, in id order. each has a name, the atlas positions of its top,
+// bottom and side tiles, whether it's solid, and the light it gives off
+#define BLOCK_BUILTINS(X) \
+  X(AIR,          "Air",          0, 0,  0, 0,  0, 0,  false, 0)  \
+  X(DIRT,         "Dirt",         1, 0,  1, 0,  1, 0,  true,  0)  \
+  X(GRASS_BLOCK,  "Grass Block",  3, 0,  1, 0,  2, 0,  true,  0)  \
+  X(PLANKS,       "Planks",       1, 1,  1, 1,  1, 1,  true,  0)  \
+  X(COBBLESTONE,  "Cobblestone",  2, 1,  2, 1,  2, 1,  true,  0)  \
+  X(TILE,         "Stone Tile",   3, 1,  3, 1,  3, 1,  true,  0)  \
+  X(LOG,          "Log",          4, 0,  4, 0,  4, 1,  true,  0)  \
+  X(LEAVES,       "Leaves",       5, 0,  5, 0,  5, 0,  false, 0)  \
+                                                                  \
+  X(CLOTH_WHITE,  "White Cloth",  1, 3,  1, 3,  1, 3,  true,  0)  \
+  X(CLOTH_RED,    "Red Cloth",    2, 3,  2, 3,  2, 3,  true,  0)  \
+  X(CLOTH_ORANGE, "Orange Cloth", 3, 3,  3, 3,  3, 3,  true,  0)  \
+  X(CLOTH_YELLOW, "Yellow Cloth", 4, 3,  4, 3,  4, 3,  true,  0)  \
+  X(CLOTH_GREEN,  "Green Cloth",  5, 3,  5, 3,  5, 3,  true,  0)  \
+  X(CLOTH_BLUE,   "Blue Cloth",   6, 3,  6, 3,  6, 3,  true,  0)  \
+  X(CLOTH_PURPLE, "Purple Cloth", 7, 3,  7, 3,  7, 3,  true,  0)  \
+  X(CLOTH_BLACK,  "Black Cloth",  8, 3,  8, 3,  8, 3,  true,  0)  \
+                                                                  \
+  /* todo: give it a tile of its own */                           \
+  X(LAMP,         "Lamp",         4, 3,  4, 3,  4, 3,  true,  15) \
+                                                                  \
+  /* fluids, see BLOCK_FLUID_LEVELS. todo: tiles of their own */  \
+  X(WATER,        "Water",        6, 3,  6, 3,  6, 3,  false, 0)  \
+  X(WATER_1,      "Water",        6, 3,  6, 3,  6, 3,  false, 0)  \
+  X(WATER_2,      "Water",        6, 3,  6, 3,  6, 3,  false, 0)  \
+  X(WATER_3,      "Water",        6, 3,  6, 3,  6, 3,  false, 0)  \
+  X(WATER_4,      "Water",        6, 3,  6, 3,  6, 3,  false, 0)  \
+  X(WATER_5,      "Water",        6, 3,  6, 3,  6, 3,  false, 0)  \
+  X(WATER_6,      "Water",        6, 3,  6, 3,  6, 3,  false, 0)  \
+  X(WATER_7,      "Water",        6, 3,  6, 3,  6, 3,  false, 0)  \
+  X(LAVA,         "Lava",         3, 3,  3, 3,  3, 3,  false, 15) \
+  X(LAVA_1,       "Lava",         3, 3,  3, 3,  3, 3,  false, 15) \
+  X(LAVA_2,       "Lava",         3, 3,  3, 3,  3, 3,  false, 15) \
+  X(LAVA_3,       "Lava",         3, 3,  3, 3,  3, 3,  false, 15) \
+  X(LAVA_4,       "Lava",         3, 3,  3, 3,  3, 3,  false, 15) \
+  X(LAVA_5,       "Lava",         3, 3,  3, 3,  3, 3,  false, 15) \
+  X(LAVA_6,       "Lava",         3, 3,  3, 3,  3, 3,  false, 15) \
+  X(LAVA_7,       "Lava",         3, 3,  3, 3,  3, 3,  false, 15)
+
+#define BLOCK_ENUM(id, ...) BLOCK_##id,
+
 typedef enum
 {
-  BLOCK_AIR,
-  BLOCK_DIRT,
-  BLOCK_GRASS_BLOCK,
-  BLOCK_PLANKS,
-  BLOCK_COBBLESTONE,
-  BLOCK_TILE,
-  BLOCK_LOG,
-  BLOCK_LEAVES,
-
-  BLOCK_CLOTH_WHITE,
-  BLOCK_CLOTH_RED,
-  BLOCK_CLOTH_ORANGE,
-  BLOCK_CLOTH_YELLOW,
-  BLOCK_CLOTH_GREEN,
-  BLOCK_CLOTH_BLUE,
-  BLOCK_CLOTH_PURPLE,
-  BLOCK_CLOTH_BLACK,
+  BLOCK_BUILTINS(BLOCK_ENUM)
 
   BLOCK_MAX,
 } block_type_t;
 
+// each fluid is a source block followed by the blocks it flows out as, one per level it drops
+#define BLOCK_FLUID_LEVELS 8
+#define BLOCK_IS_FLUID(id) \
+  (((id) >= BLOCK_WATER && (id) < BLOCK_WATER + BLOCK_FLUID_LEVELS) || \
+   ((id) >= BLOCK_LAVA && (id) < BLOCK_LAVA + BLOCK_FLUID_LEVELS))
+
+// flags in the hot table, see block_get_flags
+#define BLOCK_FLAG_SOLID       (1 << 0) // gets in the way of the player
+#define BLOCK_FLAG_OPAQUE      (1 << 1) // hides the faces of the blocks next to it
+#define BLOCK_FLAG_TRANSPARENT (1 << 2) // lets light through
+#define BLOCK_FLAG_FLUID       (1 << 3) // flows, see fluid.h
+
+// where each face's tile is in the atlas, in block_face_t order
+typedef u8 block_face_tiles_t[6];
+
 typedef enum
 {
   BLOCK_FACE_TOP,
@@ -48,11 +90,18 @@ typedef struct
   wt_vec2_t atlas_tiles[6];
 
   bool solid;
+  u8 light; // given off, up to LIGHT_MAX (see light.h)
 } block_info_t;
 
 void          block_mgr_init(void);
 
+// the built in blocks are registered by block_mgr_init, in order
 block_id_t    block_new(block_info_t *info);
 block_info_t *block_get_info(block_id_t id);
 
+// tables of what the mesher and lighting look at for every block, indexed by id. they're kept
+// apart from the block infos so the loops that need them only touch a few bytes per block
+const u8     *block_get_flags(void);
+const block_face_tiles_t *block_get_face_tiles(void);
+
 #endif
@@ -1,13 +1,21 @@
 #include "chunk.h"
+#include "light.h"
 #include "game.h"
 #include "memory.h"
 #include "job.h"
 #include "world.h"
+#include "system.h"
+#include "meshcache.h"
 #include <math.h>
+#include <string.h>
 
 typedef struct
 {
   wt_pool_t pool;
+
+  // jobs release snapshots from any thread
+  wt_pool_t data_pool;
+  sys_mutex_t data_mutex;
 } chunk_state_t;
 
 static chunk_state_t *get_state(void)
@@ -22,16 +30,44 @@ void chunk_init(void)
 
   usize pool_size = ((sizeof(chunk_t) + 0xf) & ~0xf) * (CHUNK_MAX + 2);
   s->pool = wt_pool_new(mem_hunk_push(pool_size), CHUNK_MAX + 2, sizeof(chunk_t));
+
+  usize num_data = CHUNK_MAX + 2 + CHUNK_MAX_OLD_VERSIONS;
+  usize data_pool_size = ((sizeof(chunk_data_t) + 0xf) & ~0xf) * num_data;
+  s->data_pool = wt_pool_new(mem_hunk_push(data_pool_size), num_data, sizeof(chunk_data_t));
+  s->data_mutex = sys_mutex_new();
+}
+
+static chunk_data_t *data_alloc(void)
+{
+  chunk_state_t *s = get_state();
+  sys_mutex_lock(s->data_mutex);
+  chunk_data_t *res = wt_pool_alloc(&s->data_pool);
+  sys_mutex_unlock(s->data_mutex);
+  if (res)
+  {
+    res->refs = 1;
+  }
+  return res;
 }
 
 chunk_t *chunk_new(wt_vec2_t pos)
 {
   chunk_state_t *s = get_state();
   chunk_t *res = wt_pool_alloc(&s->pool);
+  chunk_data_t *data = res ? data_alloc() : NULL;
+  if (res && !data)
+  {
+    wt_pool_free(&s->pool, res);
+    res = NULL;
+  }
+
   if (res)
   {
+    memset(res, 0, sizeof(*res));
+    res->data = data;
     res->mesh = ren_chunk_new(pos);
     res->position = pos;
+    res->status = CHUNK_STATUS_LOADING;
   }
   return res;
 }
@@ -115,12 +151,14 @@ static f32 stupid_sin(u32 x)
   return k_sin_table[x & 0xff];
 }
 
-static u32 random_from_position(int x, int y)
+// seed 0 gives the ground there was before worlds had seeds. trees used to be placed in whatever
+// order chunks loaded, so those can't come out the same
+static u32 random_from_position(int x, int y, u32 seed)
 {
-  return scramble(scramble(x ^ ~(x << (y & 0x3)) * y));
+  return scramble(scramble(x ^ ~(x << (y & 0x3)) * y) ^ seed);
 }
 
-static wt_vec2f_t random_gradient(int ix, int iy)
+static wt_vec2f_t random_gradient(int ix, int iy, u32 seed)
 {
 #if 0
   const u32 w = 8 * sizeof(u32);
@@ -132,7 +170,7 @@ static wt_vec2f_t random_gradient(int ix, int iy)
   f32 random = a * (WT_PI_F32 / ~(~0u >> 1)); // in [0, 2*Pi]
   return wt_vec2f(cos(random), sin(random));
 #else
-  u32 sc = random_from_position(ix, iy);
+  u32 sc = random_from_position(ix, iy, seed);
 
   f32 s = stupid_sin(sc);
   f32 c = stupid_sin(64 - sc);
@@ -141,9 +179,9 @@ static wt_vec2f_t random_gradient(int ix, int iy)
 #endif
 }
 
-static f32 dot_grid_gradient(int ix, int iy, f32 x, f32 y)
+static f32 dot_grid_gradient(int ix, int iy, f32 x, f32 y, u32 seed)
 {
-  wt_vec2f_t gradient = random_gradient(ix, iy);
+  wt_vec2f_t gradient = random_gradient(ix, iy, seed);
 
   f32 dx = x - (f32)ix;
   f32 dy = y - (f32)iy;
@@ -151,7 +189,7 @@ static f32 dot_grid_gradient(int ix, int iy, f32 x, f32 y)
   return (dx * gradient.x + dy * gradient.y);
 }
 
-static f32 perlin(f32 x, f32 y)
+static f32 perlin(f32 x, f32 y, u32 seed)
 {
   int x0 = (int)floor(x);
   int x1 = x0 + 1;
@@ -162,48 +200,55 @@ static f32 perlin(f32 x, f32 y)
   f32 sy = y - (f32)y0;
 
   f32 n0, n1, ix0, ix1, val;
-  n0 = dot_grid_gradient(x0, y0, x, y);
-  n1 = dot_grid_gradient(x1, y0, x, y);
+  n0 = dot_grid_gradient(x0, y0, x, y, seed);
+  n1 = dot_grid_gradient(x1, y0, x, y, seed);
   ix0 = smoothstep(n0, n1, sx);
 
-  n0 = dot_grid_gradient(x0, y1, x, y);
-  n1 = dot_grid_gradient(x1, y1, x, y);
+  n0 = dot_grid_gradient(x0, y1, x, y, seed);
+  n1 = dot_grid_gradient(x1, y1, x, y, seed);
   ix1 = smoothstep(n0, n1, sx);
 
   val = smoothstep(ix0, ix1, sy);
   return val;
 }
 
+// the ground is solid up to this height, the block at the top is grass
 #define PERLIN_NUM_STEPS 4
-static block_id_t get_block(wt_vec3_t pos)
+static f32 terrain_height(int x, int z, u32 seed)
 {
-  game_state_t *s = game_get_state();
-  if (pos.y < 200)
-  {
-    f32 p = 0;
+  f32 p = 0;
 #if 1
-    for (int i = 0; i < PERLIN_NUM_STEPS; ++i)
-    {
-      f32 m = 0.015f * (PERLIN_NUM_STEPS - i);
-      f32 s = perlin(pos.x * m, pos.z * m);
-      s = (s + 1) / 2.0f;
-      f32 lo = i * (1.0f / (PERLIN_NUM_STEPS + 1));
-      f32 hi = 1.4f - lo;
-      p *= interpolate(lo, hi, s);
-      p += 1.0f;
-    }
+  for (int i = 0; i < PERLIN_NUM_STEPS; ++i)
+  {
+    f32 m = 0.015f * (PERLIN_NUM_STEPS - i);
+    f32 s = perlin(x * m, z * m, seed);
+    s = (s + 1) / 2.0f;
+    f32 lo = i * (1.0f / (PERLIN_NUM_STEPS + 1));
+    f32 hi = 1.4f - lo;
+    p *= interpolate(lo, hi, s);
+    p += 1.0f;
+  }
 
-    p *= 50.0f;
+  p *= 50.0f;
 
-//    p = stupid_sin((f32)pos.x * 10.0f) * 10;
+//  p = stupid_sin((f32)x * 10.0f) * 10;
 
-    p += 10;
+  p += 10;
 #else
-    p = 20;
+  p = 20;
 #endif
+  return p;
+}
+
+#define TERRAIN_MAX_Y 200
 
-    bool solid = pos.y <= p;
-    bool grass = pos.y == (int)p;
+static block_id_t get_block(int y, f32 height)
+{
+  game_state_t *s = game_get_state();
+  if (y < TERRAIN_MAX_Y)
+  {
+    bool solid = y <= height;
+    bool grass = y == (int)height;
 
     if (solid)
     {
@@ -213,44 +258,70 @@ static block_id_t get_block(wt_vec3_t pos)
   return 0; // air
 }
 
-static void place_tree(wt_vec2_t pos)
+#define TREE_LEAVES_RADIUS 4
+
+static bool tree_at(int x, int z, u32 seed)
 {
-  int x = pos.x, z = pos.y;
-  int y = 0;
+  return (random_from_position(x, z, seed) & 0xff) == 0;
+}
 
-  // find the block right above the ground
-  for (y = CHUNK_SIZE_Y - 1; y >= 0; --y)
+// we don't want trees on trees. a tree doesn't grow where one that comes before it (in z, then x
+// order) would have leaves above it
+static bool tree_grows(int x, int z, u32 seed)
+{
+  if (!tree_at(x, z, seed))
   {
-    block_id_t block = world_get_block(wt_vec3(x, y, z));
-    if (block != 0)
-    {
-      y += 1;
+    return false;
+  }
 
-      // we don't want trees on trees
-      if (block == BLOCK_LEAVES)
+  i32 r = TREE_LEAVES_RADIUS;
+  for (i32 dz = -r; dz <= 0; ++dz)
+  {
+    for (i32 dx = -r; dx <= r; ++dx)
+    {
+      bool earlier = dz < 0 || dx < 0;
+      if (earlier && dx * dx + dz * dz <= r * r && tree_at(x + dx, z + dz, seed))
       {
-        return;
+        return false;
       }
-
-      break;
     }
   }
+  return true;
+}
+
+static void set_tree_block(block_id_t *blocks, wt_vec2_t origin, wt_vec3_t pos, block_id_t block)
+{
+  wt_vec3_t p = wt_vec3(pos.x - origin.x, pos.y, pos.z - origin.y);
+  if (p.x >= 0 && p.x < CHUNK_SIZE_X && p.z >= 0 && p.z < CHUNK_SIZE_Z && p.y >= 0 &&
+    p.y < CHUNK_SIZE_Y)
+  {
+    blocks[p.x + (p.z * CHUNK_SIZE_Z) + (p.y * CHUNK_SIZE_X * CHUNK_SIZE_Z)] = block;
+  }
+}
+
+// every chunk a tree reaches into places all of it, but only keeps the blocks inside itself.
+// origin is the chunk's first block
+static void place_tree(block_id_t *blocks, wt_vec2_t origin, int x, int z, u32 seed)
+{
+  // find the block right above the ground
+  f32 ground = terrain_height(x, z, seed);
+  if (ground < 0)
+  {
+    return;
+  }
+  int y = WT_MIN((int)ground, TERRAIN_MAX_Y - 1) + 1;
 
   // build a stump of random height
-  u32 height = ((random_from_position(pos.x, pos.x) ^ scramble(pos.y)) & 0x3) + 6;
+  u32 height = ((random_from_position(x, x, seed) ^ scramble(z)) & 0x3) + 6;
   for (u32 i = 0; i < height; ++i)
   {
-    wt_vec3_t log_pos = wt_vec3(x, y + i, z);
-    if (world_within_bounds(log_pos))
-    {
-      world_set_block(log_pos, BLOCK_LOG);
-    }
+    set_tree_block(blocks, origin, wt_vec3(x, y + i, z), BLOCK_LOG);
   }
 
   // make a sphere of leaves
   wt_vec3_t leaves_center = wt_vec3(x, y + height, z);
 
-  i32 radius = 4;
+  i32 radius = TREE_LEAVES_RADIUS;
   for (int yi = leaves_center.y - radius; yi < leaves_center.y + radius; ++yi)
   {
     for (int zi = leaves_center.z - radius; zi < leaves_center.z + radius; ++zi)
@@ -264,82 +335,304 @@ static void place_tree(wt_vec2_t pos)
           (f32)(offset.z * offset.z);
         f32 target_dist_sq = (f32)radius * (f32)radius;
 
-        if (world_within_bounds(leaf_pos) && dist_sq <= target_dist_sq &&
+        if (dist_sq <= target_dist_sq &&
           (xi != leaves_center.x || zi != leaves_center.z || yi > leaves_center.y))
         {
-          world_set_block(leaf_pos, BLOCK_LEAVES);
+          set_tree_block(blocks, origin, leaf_pos, BLOCK_LEAVES);
         }
       }
     }
   }
 }
 
-void chunk_gen(chunk_t *c)
+void chunk_gen_blocks(wt_vec2_t pos, u32 seed, block_id_t *blocks)
 {
-  // terrain shape
-  for (usize i = 0; i < CHUNK_NUM_BLOCKS; ++i)
-  {
-    wt_vec3_t pos = { 0 };
-    pos.x = i % CHUNK_SIZE_X;
-    pos.z = (i / CHUNK_SIZE_X) % (CHUNK_SIZE_Z);
-    pos.y = i / (CHUNK_SIZE_X * CHUNK_SIZE_Z);
+  wt_vec2_t origin = wt_vec2(pos.x * CHUNK_SIZE_X, pos.y * CHUNK_SIZE_Z);
 
-    pos = wt_vec3i_add(pos, wt_vec3i_mul_i32(wt_vec3(c->position.x, 0, c->position.y), 16));
-
-    c->blocks[i] = get_block(pos);
+  // terrain shape, the height only depends on the column
+  for (i32 z = 0; z < CHUNK_SIZE_Z; ++z)
+  {
+    for (i32 x = 0; x < CHUNK_SIZE_X; ++x)
+    {
+      f32 height = terrain_height(origin.x + x, origin.y + z, seed);
+      for (i32 y = 0; y < CHUNK_SIZE_Y; ++y)
+      {
+        blocks[x + (z * CHUNK_SIZE_Z) + (y * CHUNK_SIZE_X * CHUNK_SIZE_Z)] = get_block(y, height);
+      }
+    }
   }
 
-  // structures
-  for (usize z = 0; z < CHUNK_SIZE_Z; ++z)
+  // structures, including the ones growing in neighboring chunks that reach into this one. they're
+  // always placed in the same order, so overlapping ones come out the same from either side
+  for (i32 z = origin.y - TREE_LEAVES_RADIUS; z < origin.y + CHUNK_SIZE_Z + TREE_LEAVES_RADIUS; ++z)
   {
-    for (usize x = 0; x < CHUNK_SIZE_X; ++x)
+    for (i32 x = origin.x - TREE_LEAVES_RADIUS; x < origin.x + CHUNK_SIZE_X + TREE_LEAVES_RADIUS; ++x)
     {
-      usize wx = c->position.x * CHUNK_SIZE_X + x;
-      usize wz = c->position.y * CHUNK_SIZE_Z + z;
-
-      u32 random = random_from_position(wx, wz);
-      if ((random & 0xff) == 0)
+      if (tree_grows(x, z, seed))
       {
-        place_tree(wt_vec2(wx, wz));
+        place_tree(blocks, origin, x, z, seed);
       }
     }
   }
+}
+
+void chunk_gen(chunk_t *c, u32 seed)
+{
+  chunk_gen_blocks(c->position, seed, c->data->blocks);
+  chunk_compute_heights(c->data);
+  c->dirty_sections = CHUNK_ALL_SECTIONS;
+}
+
+// the first y going down from the given one where the column has a block, or a solid one
+static i32 find_top(block_id_t *column, i32 y, bool solid)
+{
+  const u8 *flags = block_get_flags();
+  while (y >= 0)
+  {
+    block_id_t block = column[y * CHUNK_SIZE_X * CHUNK_SIZE_Z];
+    if (solid ? flags[block] & BLOCK_FLAG_SOLID : block != 0)
+    {
+      break;
+    }
+    --y;
+  }
+  return y;
+}
 
-  c->dirty = true;
+void chunk_compute_heights(chunk_data_t *data)
+{
+  for (usize i = 0; i < CHUNK_SIZE_X * CHUNK_SIZE_Z; ++i)
+  {
+    // solid blocks can't be above the highest block
+    i32 top = find_top(data->blocks + i, CHUNK_SIZE_Y - 1, false);
+    data->heights[i] = top + 1;
+    data->solid_heights[i] = find_top(data->blocks + i, top, true) + 1;
+  }
 }
 
-void chunk_set_block(chunk_t *c, wt_vec3_t position, block_id_t block)
+void chunk_update_heights(chunk_data_t *data, wt_vec3_t position)
+{
+  usize i = position.x + position.z * CHUNK_SIZE_X;
+  block_id_t *column = data->blocks + i;
+  block_id_t block = column[position.y * CHUNK_SIZE_X * CHUNK_SIZE_Z];
+
+  // only taking away the top block means looking down for the next one
+  if (block != 0)
+  {
+    data->heights[i] = WT_MAX(data->heights[i], position.y + 1);
+  }
+  else if (data->heights[i] == position.y + 1)
+  {
+    data->heights[i] = find_top(column, position.y - 1, false) + 1;
+  }
+
+  if (block_get_flags()[block] & BLOCK_FLAG_SOLID)
+  {
+    data->solid_heights[i] = WT_MAX(data->solid_heights[i], position.y + 1);
+  }
+  else if (data->solid_heights[i] == position.y + 1)
+  {
+    data->solid_heights[i] = find_top(column, position.y - 1, true) + 1;
+  }
+}
+
+chunk_data_t *chunk_snapshot(chunk_t *c)
+{
+  sys_atomic_add(&c->data->refs, 1);
+  return c->data;
+}
+
+void chunk_release(chunk_data_t *data)
+{
+  chunk_state_t *s = get_state();
+  if (data && sys_atomic_add(&data->refs, -1) == 1)
+  {
+    sys_mutex_lock(s->data_mutex);
+    wt_pool_free(&s->data_pool, data);
+    sys_mutex_unlock(s->data_mutex);
+  }
+}
+
+bool chunk_unshare(chunk_t *c, bool keep_blocks)
+{
+  // only the main thread takes snapshots, so nobody can start sharing it while we look
+  if (c->data->refs == 1)
+  {
+    return true;
+  }
+
+  chunk_data_t *data = data_alloc();
+  if (!data)
+  {
+    return false;
+  }
+
+  if (keep_blocks)
+  {
+    memcpy(data->blocks, c->data->blocks, sizeof(data->blocks));
+    memcpy(data->light, c->data->light, sizeof(data->light));
+    memcpy(data->heights, c->data->heights, sizeof(data->heights));
+    memcpy(data->solid_heights, c->data->solid_heights, sizeof(data->solid_heights));
+  }
+  chunk_release(c->data);
+  c->data = data;
+  return true;
+}
+
+u32 chunk_sections_touched(wt_vec3_t position)
+{
+  // the block's own section, and the one next to it if it's on the edge
+  u32 section = position.y / CHUNK_SECTION_SIZE_Y;
+  u32 res = 1u << section;
+  if (position.y % CHUNK_SECTION_SIZE_Y == 0 && section > 0)
+  {
+    res |= 1u << (section - 1);
+  }
+  if (position.y % CHUNK_SECTION_SIZE_Y == CHUNK_SECTION_SIZE_Y - 1 && section < CHUNK_NUM_SECTIONS - 1)
+  {
+    res |= 1u << (section + 1);
+  }
+  return res;
+}
+
+bool chunk_set_block(chunk_t *c, wt_vec3_t position, block_id_t block)
 {
   usize offset = position.x + (position.z * CHUNK_SIZE_Z) + (position.y * CHUNK_SIZE_X * CHUNK_SIZE_Z);
   WT_ASSERT(offset < CHUNK_NUM_BLOCKS);
-  c->blocks[offset] = block;
-  c->dirty = true;
+  if (!chunk_unshare(c, true))
+  {
+    return false;
+  }
+  c->dirty_sections |= chunk_sections_touched(position);
+  c->data->blocks[offset] = block;
+  chunk_update_heights(c->data, position);
+  c->modified = true;
+  return true;
+}
+
+block_id_t *chunk_edit_blocks(chunk_t *c)
+{
+  if (!chunk_unshare(c, true))
+  {
+    return NULL;
+  }
+  c->modified = true;
+  return c->data->blocks;
 }
 
 block_id_t chunk_get_block(chunk_t *c, wt_vec3_t position)
 {
   usize offset = position.x + (position.z * CHUNK_SIZE_Z) + (position.y * CHUNK_SIZE_X * CHUNK_SIZE_Z);
   WT_ASSERT(offset < CHUNK_NUM_BLOCKS);
-  return c->blocks[offset];
+  return c->data->blocks[offset];
 }
 
-void rebuild_job(void *param)
+void chunk_get_padded(chunk_data_t *chunks[5], block_id_t *padded, u8 *padded_light)
+{
+  // where each neighbor's touching column goes in the padding, and where it is in the neighbor
+  static const wt_vec2_t k_dst[] = { { -1, 0 }, { CHUNK_SIZE_X, 0 }, { 0, -1 }, { 0, CHUNK_SIZE_Z } };
+  static const wt_vec2_t k_src[] = { { CHUNK_SIZE_X - 1, 0 }, { 0, 0 }, { 0, CHUNK_SIZE_Z - 1 }, { 0, 0 } };
+  static const usize k_dst_step[] = { CHUNK_PADDED_SIZE_X, CHUNK_PADDED_SIZE_X, 1, 1 };
+  static const usize k_src_step[] = { CHUNK_SIZE_X, CHUNK_SIZE_X, 1, 1 };
+
+  // the padding is lit like open sky, except underneath
+  memset(padded, 0, CHUNK_PADDED_NUM_BLOCKS * sizeof(block_id_t));
+  memset(padded_light, LIGHT_MAX << 4, CHUNK_PADDED_NUM_BLOCKS);
+  memset(padded_light, 0, CHUNK_PADDED_SIZE_X * CHUNK_PADDED_SIZE_Z);
+
+  chunk_data_t *data = chunks[0];
+  for (usize y = 0; y < CHUNK_SIZE_Y; ++y)
+  {
+    for (usize z = 0; z < CHUNK_SIZE_Z; ++z)
+    {
+      usize src = z * CHUNK_SIZE_X + y * CHUNK_SIZE_X * CHUNK_SIZE_Z;
+      memcpy(padded + CHUNK_PADDED_INDEX(0, y, z), data->blocks + src, CHUNK_SIZE_X * sizeof(block_id_t));
+      memcpy(padded_light + CHUNK_PADDED_INDEX(0, y, z), data->light + src, CHUNK_SIZE_X);
+    }
+  }
+
+  for (usize side = 0; side < 4; ++side)
+  {
+    chunk_data_t *n = chunks[side + 1];
+    if (!n)
+    {
+      continue;
+    }
+
+    for (usize y = 0; y < CHUNK_SIZE_Y; ++y)
+    {
+      usize dst = CHUNK_PADDED_INDEX(k_dst[side].x, y, k_dst[side].y);
+      usize src = k_src[side].x + k_src[side].y * CHUNK_SIZE_X + y * CHUNK_SIZE_X * CHUNK_SIZE_Z;
+      for (usize i = 0; i < CHUNK_SIZE_X; ++i)
+      {
+        padded[dst + i * k_dst_step[side]] = n->blocks[src + i * k_src_step[side]];
+        padded_light[dst + i * k_dst_step[side]] = n->light[src + i * k_src_step[side]];
+      }
+    }
+  }
+}
+
+static void rebuild_job(void *param)
 {
   chunk_t *c = (chunk_t*)param;
-  ren_chunk_generate_mesh(c->mesh, c->blocks);
+  mem_scratch_begin();
+
+  // everything the meshes depend on is gathered once up front, the keys and the meshes both use it
+  block_id_t *padded = mem_scratch_push(CHUNK_PADDED_NUM_BLOCKS * sizeof(block_id_t));
+  u8 *padded_light = mem_scratch_push(CHUNK_PADDED_NUM_BLOCKS);
+  chunk_get_padded(c->mesh_snapshots, padded, padded_light);
+
+  for (usize section = 0; section < CHUNK_NUM_SECTIONS; ++section)
+  {
+    if (!(c->meshing_sections & (1u << section)))
+    {
+      continue;
+    }
+
+    mem_scratch_begin();
+    wt_hash_u128_t key = meshcache_key(padded, padded_light, section);
+    ren_chunk_mesh_t mesh = { 0 };
+    if (!meshcache_find(key, &mesh))
+    {
+      mesh = ren_chunk_build_mesh(padded, padded_light, section);
+      meshcache_store(key, &mesh);
+    }
+    ren_chunk_upload_mesh(c->mesh, section, &mesh);
+    mem_scratch_end();
+  }
+
+  mem_scratch_end();
+  for (usize i = 0; i < WT_ARRAY_COUNT(c->mesh_snapshots); ++i)
+  {
+    chunk_release(c->mesh_snapshots[i]);
+  }
+  sys_atomic_exchange(&c->meshing, 0);
 }
 
-void chunk_rebuild_mesh(chunk_t *c)
+static void rebuild_mesh(chunk_t *c)
 {
-  job_queue(rebuild_job, c);
+  static const wt_vec2_t k_neighbors[] = { { -1, 0 }, { 1, 0 }, { 0, -1 }, { 0, 1 } };
+
+  // neighbors that are still loading are being written to, they get remeshed once they're ready
+  c->mesh_snapshots[0] = chunk_snapshot(c);
+  for (usize i = 0; i < WT_ARRAY_COUNT(k_neighbors); ++i)
+  {
+    chunk_t *n = world_get_chunk(wt_vec2i_add(c->position, k_neighbors[i]));
+    c->mesh_snapshots[i + 1] = n && n->status == CHUNK_STATUS_READY ? chunk_snapshot(n) : NULL;
+  }
+
+  c->meshing_sections = c->dirty_sections;
+  c->meshing = 1;
+  job_queue_counted(rebuild_job, c, &c->num_jobs);
 }
 
 void chunk_render(chunk_t *c)
 {
-  if (c->dirty)
+  // edits made while a mesh job is running get picked up by the next one
+  if (c->dirty_sections && !c->meshing)
   {
-    chunk_rebuild_mesh(c);
-    c->dirty = false;
+    rebuild_mesh(c);
+    c->dirty_sections = 0;
   }
 
   ren_draw_chunk(c->mesh);
@@ -348,6 +641,8 @@ void chunk_render(chunk_t *c)
 void chunk_free(chunk_t *c)
 {
   chunk_state_t *s = get_state();
+  WT_ASSERT(c->num_jobs == 0 && "freeing a chunk that a job is still using");
   ren_chunk_free(c->mesh);
+  chunk_release(c->data);
   wt_pool_free(&s->pool, c);
 }
@@ -1,28 +1,111 @@
 #ifndef CHUNK_H
 #define CHUNK_H
 
-#define CHUNK_MAX 4096
-
 #include <wt/wt.h>
 #include "constants.h"
 #include "block.h"
 #include "renderer.h"
 
+// a chunk's blocks with a block of padding all around, filled in from its neighbors on the sides
+// and with air above, below and in the corners. the mesher reads it without any bounds checks.
+// positions are relative to the chunk, so each goes from -1 to its size
+#define CHUNK_PADDED_SIZE_X (CHUNK_SIZE_X + 2)
+#define CHUNK_PADDED_SIZE_Y (CHUNK_SIZE_Y + 2)
+#define CHUNK_PADDED_SIZE_Z (CHUNK_SIZE_Z + 2)
+#define CHUNK_PADDED_NUM_BLOCKS (CHUNK_PADDED_SIZE_X * CHUNK_PADDED_SIZE_Y * CHUNK_PADDED_SIZE_Z)
+#define CHUNK_PADDED_INDEX(x, y, z) (((x) + 1) + ((z) + 1) * CHUNK_PADDED_SIZE_X + \
+  ((y) + 1) * CHUNK_PADDED_SIZE_X * CHUNK_PADDED_SIZE_Z)
+
+#define CHUNK_ALL_SECTIONS ((1u << CHUNK_NUM_SECTIONS) - 1)
+
+// needs to be comfortably more than the chunks covered by tickets (see world.h)
+#define CHUNK_MAX (CHUNK_MEMORY_BUDGET / (sizeof(chunk_t) + sizeof(chunk_data_t)))
+
+// block arrays on top of one per chunk, for old versions that jobs still hold snapshots of.
+// once they run out, writes to shared chunks fail until a job lets go of one
+#define CHUNK_MAX_OLD_VERSIONS 64
+
+typedef enum
+{
+  CHUNK_STATUS_LOADING, // being generated or decompressed on a worker, don't touch the blocks
+  CHUNK_STATUS_READY,
+} chunk_status_t;
+
+typedef enum
+{
+  CHUNK_SAVE_NONE,
+  CHUNK_SAVE_PENDING, // world_save was called, the blocks need saving before they change
+} chunk_save_state_t;
+
+// a version of a chunk's blocks. jobs hold snapshots of the version that was current when they
+// were queued, and the main thread writes to a copy while any snapshot is held, so jobs never see
+// blocks change under them
 typedef struct
 {
-  wt_vec2_t position;
+  volatile i32 refs;
   block_id_t blocks[CHUNK_NUM_BLOCKS];
+  u8 light[CHUNK_NUM_BLOCKS]; // see light.h, worked out again on load rather than saved
+
+  // per column, one above the highest block that isn't air and the highest solid one, 0 if there
+  // isn't any. kept up to date by chunk_set_block, or chunk_update_heights for direct writes
+  u16 heights[CHUNK_SIZE_X * CHUNK_SIZE_Z];
+  u16 solid_heights[CHUNK_SIZE_X * CHUNK_SIZE_Z];
+} chunk_data_t;
+
+typedef struct
+{
+  wt_vec2_t position;
+  chunk_data_t *data; // the current version
 
   ren_chunk_t mesh;
-  bool dirty;
+  u32 dirty_sections; // a bit per section whose mesh is out of date
+  bool modified; // changed since the chunk was last saved, only modified chunks get written
+
+  // snapshots the mesh job in flight works from: this chunk, then its neighbors (see
+  // chunk_get_padded). there's only ever one, further rebuilds wait until it's done
+  chunk_data_t *mesh_snapshots[5];
+  u32 meshing_sections;
+  volatile i32 meshing;
+
+  chunk_status_t status;
+  volatile i32 num_jobs; // jobs in flight that reference this chunk
+  bool load_failed; // its stored blocks didn't decompress, it was generated again instead
+  u16 fluid_sections; // a bit per section that had fluid in it when it loaded, see fluid.h
+  chunk_save_state_t save_state;
+  u64 last_used_tick;
 } chunk_t;
 
 void       chunk_init(void);
 chunk_t   *chunk_new(wt_vec2_t pos);
-void       chunk_gen(chunk_t *c);
-void       chunk_set_block(chunk_t *c, wt_vec3_t position, block_id_t block);
+// generation is a pure function of the position and the world seed, so chunks that nobody has
+// changed never need to be stored. they can be generated again exactly the same
+void       chunk_gen_blocks(wt_vec2_t pos, u32 seed, block_id_t *blocks);
+void       chunk_gen(chunk_t *c, u32 seed);
+// false if the chunk is shared and there's no version to copy it to, see chunk_unshare
+bool       chunk_set_block(chunk_t *c, wt_vec3_t position, block_id_t block);
+// works out every column's heights from scratch, or one column's after a block in it changed
+void       chunk_compute_heights(chunk_data_t *data);
+void       chunk_update_heights(chunk_data_t *data, wt_vec3_t position);
+// the sections whose meshes read a block, its own and the one next to it on a section's edge
+u32        chunk_sections_touched(wt_vec3_t position);
 block_id_t chunk_get_block(chunk_t *c, wt_vec3_t position);
-void       chunk_rebuild_mesh(chunk_t *c);
+
+// snapshots can only be taken on the main thread, they can be released from anywhere
+chunk_data_t *chunk_snapshot(chunk_t *c);
+void       chunk_release(chunk_data_t *data);
+
+// gives the chunk a version of its blocks nobody else holds. a job that overwrites every block
+// (loading) doesn't need the old ones or their light kept. false if every old version is taken,
+// the chunk is left as it was
+bool       chunk_unshare(chunk_t *c, bool keep_blocks);
+// unshares the chunk and marks it changed, for writing many of its blocks at once. the caller
+// marks the sections it changes dirty and updates the heights. NULL if it couldn't be unshared
+block_id_t *chunk_edit_blocks(chunk_t *c);
+
+// copies a chunk and the sides of its neighbors into one padded volume, and their light into
+// another. chunks[0] is the chunk, then its -x, +x, -z and +z neighbors, NULL where there's no
+// chunk to read
+void       chunk_get_padded(chunk_data_t *chunks[5], block_id_t *padded, u8 *padded_light);
 void       chunk_render(chunk_t *c);
 void       chunk_free(chunk_t *c);
 
@@ -0,0 +1,649 @@
+#include "codec.h"
+#include "game.h"
+#include "memory.h"
+#include "system.h"
+#include "job.h"
+#include "constants.h"
+#include <string.h>
+#include <immintrin.h>
+#include <zstd.h>
+
+typedef struct
+{
+  codec_id_t codec;
+  i32 level; // zstd only
+} codec_profile_info_t;
+
+static const codec_profile_info_t k_profiles[CODEC_PROFILE_MAX] = {
+  [CODEC_PROFILE_STASH] = { CODEC_PALETTE, CODEC_ZSTD_STASH_LEVEL },
+  [CODEC_PROFILE_SAVE]  = { CODEC_PALETTE, CODEC_ZSTD_SAVE_LEVEL },
+  // the cheapest to encode and decode, a link is rarely slow enough for zstd to pay off
+  [CODEC_PROFILE_NETWORK] = { CODEC_RLE, 0 },
+};
+
+typedef struct
+{
+  // one of each per worker, the main thread gets the last ones
+  ZSTD_CCtx **cctxs;
+  ZSTD_DCtx **dctxs;
+  usize num_ctxs;
+} codec_state_t;
+
+static codec_state_t *get_state(void)
+{
+  return game_get_state()->modules.codec;
+}
+
+void codec_init(void)
+{
+  game_state_t *gs = game_get_state();
+  codec_state_t *s = gs->modules.codec = mem_hunk_push(sizeof(codec_state_t));
+
+  s->num_ctxs = job_get_num_workers() + 1;
+  s->cctxs = mem_hunk_push(s->num_ctxs * sizeof(ZSTD_CCtx*));
+  s->dctxs = mem_hunk_push(s->num_ctxs * sizeof(ZSTD_DCtx*));
+  for (usize i = 0; i < s->num_ctxs; ++i)
+  {
+    s->cctxs[i] = ZSTD_createCCtx();
+    s->dctxs[i] = ZSTD_createDCtx();
+  }
+}
+
+// decompresses up to max_chunks chunks, and no more than max_per_world from any single world, into
+// scratch memory one after the other. old worlds are a single file, repeated for every chunk: position, compressed size, zstd payload
+static usize load_sample_chunks(const char **world_filenames, usize num_worlds, usize max_per_world,
+  usize max_chunks, byte_t **out)
+{
+  usize chunk_size = CHUNK_NUM_BLOCKS * sizeof(block_id_t);
+  usize num_chunks = 0;
+  byte_t *chunks = mem_scratch_push(max_chunks * chunk_size);
+
+  for (usize i = 0; i < num_worlds && num_chunks < max_chunks; ++i)
+  {
+    usize world_end = WT_MIN(num_chunks + max_per_world, max_chunks);
+    sys_file_t file = sys_file_open(world_filenames[i], SYS_FILE_READ);
+    if (!file)
+    {
+      continue;
+    }
+
+    usize file_size = sys_file_get_size(file);
+    byte_t *data = mem_scratch_push(file_size);
+    if (sys_file_read(file, data, file_size))
+    {
+      usize pos = 0;
+      while (pos + sizeof(wt_vec2_t) + sizeof(usize) <= file_size && num_chunks < world_end)
+      {
+        usize cmp_size = 0;
+        memcpy(&cmp_size, data + pos + sizeof(wt_vec2_t), sizeof(usize));
+        pos += sizeof(wt_vec2_t) + sizeof(usize);
+        if (pos + cmp_size > file_size)
+        {
+          break;
+        }
+        if (cmp_size == 0)
+        {
+          continue; // chunk wasn't saved
+        }
+
+        usize size = ZSTD_decompress(chunks + num_chunks * chunk_size, chunk_size, data + pos, cmp_size);
+        if (size == chunk_size)
+        {
+          num_chunks += 1;
+        }
+        pos += cmp_size;
+      }
+    }
+    sys_file_close(file);
+  }
+
+  *out = chunks;
+  return num_chunks;
+}
+
+static usize get_ctx_index(void)
+{
+  codec_state_t *s = get_state();
+  isize worker = job_get_worker_id();
+  return worker == -1 ? s->num_ctxs - 1 : (usize)worker;
+}
+
+// pairs of (run length, block id). returns 0 if it wouldn't be any smaller than the blocks
+static usize rle_compress(u32 *dst, usize dst_size, const u32 *src, usize src_size)
+{
+  usize num_src = src_size / sizeof(u32);
+  usize max_dst = WT_MIN(dst_size, src_size) / sizeof(u32);
+  usize num_dst = 0;
+
+  for (usize i = 0; i < num_src;)
+  {
+    usize run = 1;
+    while (i + run < num_src && src[i + run] == src[i])
+    {
+      run += 1;
+    }
+
+    if (num_dst + 2 > max_dst)
+    {
+      return 0;
+    }
+    dst[num_dst++] = (u32)run;
+    dst[num_dst++] = src[i];
+    i += run;
+  }
+  return num_dst * sizeof(u32);
+}
+
+static usize rle_decompress(u32 *dst, usize dst_size, const u32 *src, usize src_size)
+{
+  usize num_dst = 0;
+  usize max_dst = dst_size / sizeof(u32);
+  for (usize i = 0; i + 1 < src_size / sizeof(u32); i += 2)
+  {
+    u32 run = src[i];
+    if (num_dst + run > max_dst)
+    {
+      return 0;
+    }
+    for (u32 j = 0; j < run; ++j)
+    {
+      dst[num_dst + j] = src[i + 1];
+    }
+    num_dst += run;
+  }
+  return num_dst * sizeof(u32);
+}
+
+// palette encoding: the distinct blocks of a chunk, then for every block an index into them. the
+// indices are either bit-packed, or stored as vertical runs when that's smaller. the runs of all
+// the columns are interleaved layer by layer in the order they start, so the decoder can write
+// whole layers at once and copy the same layer over until the next run starts
+typedef enum
+{
+  PALETTE_SINGLE,  // the whole chunk is a single block
+  PALETTE_PACKED,  // indices packed into bits bits each, in block order
+  PALETTE_COLUMNS, // (index, run length - 1) pairs, indices are a byte or two depending on the palette size
+} palette_mode_t;
+
+typedef struct
+{
+  u16 palette_size;
+  u8 mode;
+  u8 bits;
+} palette_header_t;
+
+#define PALETTE_LAYER_SIZE (CHUNK_SIZE_X * CHUNK_SIZE_Z)
+#define PALETTE_HASH_SIZE (CODEC_PALETTE_MAX_SIZE * 2)
+#define PALETTE_HASH_EMPTY 0xffff
+#define PALETTE_MAX_ENCODED_SIZE (sizeof(palette_header_t) + CODEC_PALETTE_MAX_SIZE * sizeof(block_id_t) + \
+  CHUNK_NUM_BLOCKS * sizeof(u16))
+
+static u32 palette_hash(block_id_t block)
+{
+  return (block * 2654435761u) >> 19 & (PALETTE_HASH_SIZE - 1);
+}
+
+// builds the palette and the index of every block, returns the palette size or 0 if there are too
+// many different blocks
+static usize palette_build(const block_id_t *blocks, block_id_t *palette, u16 *indices)
+{
+  mem_scratch_begin();
+  block_id_t *keys = mem_scratch_push(PALETTE_HASH_SIZE * sizeof(block_id_t));
+  u16 *values = mem_scratch_push(PALETTE_HASH_SIZE * sizeof(u16));
+  memset(values, 0xff, PALETTE_HASH_SIZE * sizeof(u16));
+
+  usize palette_size = 0;
+  block_id_t prev_block = blocks[0];
+  u16 prev_index = PALETTE_HASH_EMPTY;
+  for (usize i = 0; i < CHUNK_NUM_BLOCKS; i += 4)
+  {
+    // most of a chunk is long runs of the same block, skip the lookup for those 4 at a time
+    __m128i v = _mm_loadu_si128((const __m128i*)(blocks + i));
+    if (prev_index != PALETTE_HASH_EMPTY &&
+      _mm_movemask_epi8(_mm_cmpeq_epi32(v, _mm_set1_epi32((i32)prev_block))) == 0xffff)
+    {
+      _mm_storel_epi64((__m128i*)(indices + i), _mm_set1_epi16((i16)prev_index));
+      continue;
+    }
+
+    for (usize j = i; j < i + 4; ++j)
+    {
+      block_id_t block = blocks[j];
+      if (block != prev_block || prev_index == PALETTE_HASH_EMPTY)
+      {
+        u32 slot = palette_hash(block);
+        while (values[slot] != PALETTE_HASH_EMPTY && keys[slot] != block)
+        {
+          slot = (slot + 1) & (PALETTE_HASH_SIZE - 1);
+        }
+        if (values[slot] == PALETTE_HASH_EMPTY)
+        {
+          if (palette_size == CODEC_PALETTE_MAX_SIZE)
+          {
+            mem_scratch_end();
+            return 0;
+          }
+          keys[slot] = block;
+          values[slot] = (u16)palette_size;
+          palette[palette_size++] = block;
+        }
+        prev_block = block;
+        prev_index = values[slot];
+      }
+      indices[j] = prev_index;
+    }
+  }
+
+  mem_scratch_end();
+  return palette_size;
+}
+
+static usize palette_encode_packed(byte_t *dst, usize dst_size, const u16 *indices, u32 bits)
+{
+  usize size = CHUNK_NUM_BLOCKS * bits / 8;
+  if (size > dst_size)
+  {
+    return 0;
+  }
+
+  memset(dst, 0, size);
+  if (bits == 16)
+  {
+    memcpy(dst, indices, size);
+    return size;
+  }
+
+  u32 per_byte = 8 / bits;
+  for (usize i = 0; i < CHUNK_NUM_BLOCKS; ++i)
+  {
+    dst[i / per_byte] |= (byte_t)(indices[i] << (i % per_byte * bits));
+  }
+  return size;
+}
+
+// returns 0 if the runs don't fit in dst_size
+static usize palette_encode_columns(byte_t *dst, usize dst_size, const u16 *indices, usize palette_size)
+{
+  usize index_size = palette_size > 256 ? 2 : 1;
+  usize size = 0;
+  u16 run_end[PALETTE_LAYER_SIZE] = {0};
+
+  for (usize y = 0; y < CHUNK_SIZE_Y;)
+  {
+    usize next_start = CHUNK_SIZE_Y;
+    for (usize c = 0; c < PALETTE_LAYER_SIZE; ++c)
+    {
+      if (run_end[c] == y)
+      {
+        u16 index = indices[y * PALETTE_LAYER_SIZE + c];
+        usize end = y + 1;
+        while (end < CHUNK_SIZE_Y && indices[end * PALETTE_LAYER_SIZE + c] == index)
+        {
+          end += 1;
+        }
+
+        if (size + index_size + 1 > dst_size)
+        {
+          return 0;
+        }
+        memcpy(dst + size, &index, index_size);
+        dst[size + index_size] = (byte_t)(end - y - 1);
+        size += index_size + 1;
+        run_end[c] = (u16)end;
+      }
+      next_start = WT_MIN(next_start, run_end[c]);
+    }
+    y = next_start;
+  }
+  return size;
+}
+
+// returns 0 if the chunk can't be palette encoded
+static usize palette_encode(byte_t *dst, usize dst_size, const block_id_t *blocks)
+{
+  mem_scratch_begin();
+  block_id_t *palette = mem_scratch_push(CODEC_PALETTE_MAX_SIZE * sizeof(block_id_t));
+  u16 *indices = mem_scratch_push(CHUNK_NUM_BLOCKS * sizeof(u16));
+  usize palette_size = palette_build(blocks, palette, indices);
+
+  usize header_size = sizeof(palette_header_t) + palette_size * sizeof(block_id_t);
+  if (palette_size == 0 || header_size > dst_size)
+  {
+    mem_scratch_end();
+    return 0;
+  }
+
+  palette_header_t header = { (u16)palette_size, PALETTE_SINGLE, 0 };
+  usize payload_size = 0;
+  if (palette_size > 1)
+  {
+    // round up to a power of two so indices never straddle a byte
+    header.bits = 1;
+    while (((usize)1 << header.bits) < palette_size)
+    {
+      header.bits *= 2;
+    }
+
+    byte_t *payload = dst + header_size;
+    usize max_payload_size = dst_size - header_size;
+    header.mode = PALETTE_COLUMNS;
+    payload_size = palette_encode_columns(payload, WT_MIN(max_payload_size,
+      CHUNK_NUM_BLOCKS * header.bits / 8), indices, palette_size);
+    if (payload_size == 0)
+    {
+      header.mode = PALETTE_PACKED;
+      payload_size = palette_encode_packed(payload, max_payload_size, indices, header.bits);
+      if (payload_size == 0)
+      {
+        mem_scratch_end();
+        return 0;
+      }
+    }
+  }
+
+  memcpy(dst, &header, sizeof(header));
+  memcpy(dst + sizeof(header), palette, palette_size * sizeof(block_id_t));
+  mem_scratch_end();
+  return header_size + payload_size;
+}
+
+// copies a layer of blocks over count layers
+static void palette_fill_layers(block_id_t *dst, const block_id_t *layer, usize count)
+{
+  for (usize y = 0; y < count; ++y)
+  {
+    for (usize i = 0; i < PALETTE_LAYER_SIZE; i += 4)
+    {
+      _mm_storeu_si128((__m128i*)(dst + y * PALETTE_LAYER_SIZE + i),
+        _mm_loadu_si128((const __m128i*)(layer + i)));
+    }
+  }
+}
+
+static usize palette_decode(block_id_t *dst, usize dst_size, const byte_t *src, usize src_size)
+{
+  palette_header_t header;
+  if (src_size < sizeof(header) || dst_size < CHUNK_NUM_BLOCKS * sizeof(block_id_t))
+  {
+    return 0;
+  }
+  memcpy(&header, src, sizeof(header));
+
+  // every index read below is checked against the palette size too
+  usize header_size = sizeof(header) + header.palette_size * sizeof(block_id_t);
+  if (header.palette_size == 0 || header.palette_size > CODEC_PALETTE_MAX_SIZE ||
+    header_size > src_size)
+  {
+    return 0;
+  }
+  block_id_t palette[CODEC_PALETTE_MAX_SIZE];
+  memcpy(palette, src + sizeof(header), header.palette_size * sizeof(block_id_t));
+  const byte_t *payload = src + header_size;
+  usize payload_size = src_size - header_size;
+
+  switch (header.mode)
+  {
+    case PALETTE_SINGLE:
+    {
+      block_id_t layer[PALETTE_LAYER_SIZE];
+      for (usize i = 0; i < PALETTE_LAYER_SIZE; ++i)
+      {
+        layer[i] = palette[0];
+      }
+      palette_fill_layers(dst, layer, CHUNK_SIZE_Y);
+      break;
+    }
+    case PALETTE_PACKED:
+    {
+      u32 bits = header.bits;
+      if (bits == 0 || bits > 16 || payload_size < CHUNK_NUM_BLOCKS * bits / 8)
+      {
+        return 0;
+      }
+
+      u32 mask = (1u << bits) - 1;
+      for (usize i = 0; i < CHUNK_NUM_BLOCKS; ++i)
+      {
+        u32 index = 0;
+        if (bits == 16)
+        {
+          u16 wide;
+          memcpy(&wide, payload + i * sizeof(wide), sizeof(wide));
+          index = wide;
+        }
+        else
+        {
+          index = (u32)(payload[i * bits / 8] >> (i * bits % 8)) & mask;
+        }
+        if (index >= header.palette_size)
+        {
+          return 0;
+        }
+        dst[i] = palette[index];
+      }
+      break;
+    }
+    case PALETTE_COLUMNS:
+    {
+      usize index_size = header.palette_size > 256 ? 2 : 1;
+      block_id_t layer[PALETTE_LAYER_SIZE];
+      u16 run_end[PALETTE_LAYER_SIZE] = {0};
+      usize pos = 0;
+
+      // every layer until the next run starts is a copy of the current one
+      for (usize y = 0; y < CHUNK_SIZE_Y;)
+      {
+        usize next_start = CHUNK_SIZE_Y;
+        for (usize c = 0; c < PALETTE_LAYER_SIZE; ++c)
+        {
+          if (run_end[c] == y)
+          {
+            if (pos + index_size + 1 > payload_size)
+            {
+              return 0;
+            }
+            u16 index = 0;
+            memcpy(&index, payload + pos, index_size);
+            usize end = y + 1 + payload[pos + index_size];
+            pos += index_size + 1;
+            if (index >= header.palette_size || end > CHUNK_SIZE_Y)
+            {
+              return 0;
+            }
+            layer[c] = palette[index];
+            run_end[c] = (u16)end;
+          }
+          next_start = WT_MIN(next_start, run_end[c]);
+        }
+
+        palette_fill_layers(dst + y * PALETTE_LAYER_SIZE, layer, next_start - y);
+        y = next_start;
+      }
+      break;
+    }
+    default:
+    {
+      return 0;
+    }
+  }
+  return CHUNK_NUM_BLOCKS * sizeof(block_id_t);
+}
+
+static usize zstd_compress(i32 level, void *dst, usize dst_size, const void *src, usize src_size)
+{
+  codec_state_t *s = get_state();
+  ZSTD_CCtx *cctx = s->cctxs[get_ctx_index()];
+  usize size = ZSTD_compressCCtx(cctx, dst, dst_size, src, src_size, level);
+  return ZSTD_isError(size) ? 0 : size;
+}
+
+static usize zstd_decompress(void *dst, usize dst_size, const void *src, usize src_size)
+{
+  codec_state_t *s = get_state();
+  ZSTD_DCtx *dctx = s->dctxs[get_ctx_index()];
+
+  // chunks used to be compressed against a dictionary, there's no reading those anymore
+  if (ZSTD_getDictID_fromFrame(src, src_size) != 0)
+  {
+    return 0;
+  }
+  usize size = ZSTD_decompressDCtx(dctx, dst, dst_size, src, src_size);
+  return ZSTD_isError(size) ? 0 : size;
+}
+
+static usize palette_compress(i32 level, void *dst, usize dst_size, const void *src, usize src_size)
+{
+  if (src_size != CHUNK_NUM_BLOCKS * sizeof(block_id_t))
+  {
+    return 0;
+  }
+
+  mem_scratch_begin();
+  byte_t *encoded = mem_scratch_push(PALETTE_MAX_ENCODED_SIZE);
+  usize encoded_size = palette_encode(encoded, PALETTE_MAX_ENCODED_SIZE, src);
+  usize size = encoded_size > 0 ? zstd_compress(level, dst, dst_size, encoded, encoded_size) : 0;
+  mem_scratch_end();
+  return size;
+}
+
+static usize palette_decompress(void *dst, usize dst_size, const void *src, usize src_size)
+{
+  mem_scratch_begin();
+  byte_t *encoded = mem_scratch_push(PALETTE_MAX_ENCODED_SIZE);
+  usize encoded_size = zstd_decompress(encoded, PALETTE_MAX_ENCODED_SIZE, src, src_size);
+  usize size = encoded_size > 0 ? palette_decode(dst, dst_size, encoded, encoded_size) : 0;
+  mem_scratch_end();
+  return size;
+}
+
+static usize compress_with(codec_id_t codec, i32 level, void *dst, usize dst_size, const void *src,
+  usize src_size)
+{
+  switch (codec)
+  {
+    case CODEC_ZSTD:    return zstd_compress(level, dst, dst_size, src, src_size);
+    case CODEC_PALETTE: return palette_compress(level, dst, dst_size, src, src_size);
+    case CODEC_RLE:     return rle_compress(dst, dst_size, src, src_size);
+    case CODEC_RAW:
+    {
+      if (src_size > dst_size)
+      {
+        return 0;
+      }
+      memcpy(dst, src, src_size);
+      return src_size;
+    }
+    default: return 0;
+  }
+}
+
+usize codec_compress(codec_profile_t profile, void *dst, usize dst_size, const void *src,
+  usize src_size, codec_id_t *codec)
+{
+  const codec_profile_info_t *p = &k_profiles[profile];
+  usize size = compress_with(p->codec, p->level, dst, dst_size, src, src_size);
+  *codec = p->codec;
+  if (size == 0 || size >= src_size)
+  {
+    size = compress_with(CODEC_RAW, 0, dst, dst_size, src, src_size);
+    *codec = CODEC_RAW;
+  }
+  return size;
+}
+
+usize codec_decompress(codec_id_t codec, void *dst, usize dst_size, const void *src,
+  usize src_size)
+{
+  switch (codec)
+  {
+    case CODEC_ZSTD:    return zstd_decompress(dst, dst_size, src, src_size);
+    case CODEC_PALETTE: return palette_decompress(dst, dst_size, src, src_size);
+    case CODEC_RLE:     return rle_decompress(dst, dst_size, src, src_size);
+    case CODEC_RAW:
+    {
+      if (src_size > dst_size)
+      {
+        return 0;
+      }
+      memcpy(dst, src, src_size);
+      return src_size;
+    }
+    default:
+    {
+      return 0; // the id came from a corrupt file
+    }
+  }
+}
+
+#define CODEC_BENCHMARK_MAX_CHUNKS 768
+
+// the sample worlds are still in the old single file format. test.world is only a header now, its
+// chunks are in region files
+static const char *k_benchmark_worlds[] = {
+  "worlds/house-and-tower-8x8.world",
+  "worlds/mayo-and-clink-16x16.world",
+};
+
+void codec_dbg_benchmark(void)
+{
+  usize chunk_size = CHUNK_NUM_BLOCKS * sizeof(block_id_t);
+
+  mem_scratch_begin();
+  byte_t *chunks = NULL;
+  usize num_worlds = WT_ARRAY_COUNT(k_benchmark_worlds);
+  usize num_chunks = load_sample_chunks(k_benchmark_worlds, num_worlds,
+    CODEC_BENCHMARK_MAX_CHUNKS / num_worlds, CODEC_BENCHMARK_MAX_CHUNKS, &chunks);
+
+  usize cmp_buf_size = ZSTD_compressBound(chunk_size);
+  byte_t *cmp_buf = mem_scratch_push(cmp_buf_size);
+  byte_t *out_buf = mem_scratch_push(chunk_size);
+
+  struct { const char *name; codec_id_t codec; i32 level; } configs[] = {
+    { "raw",             CODEC_RAW,     0  },
+    { "rle",             CODEC_RLE,     0  },
+    { "zstd -5",         CODEC_ZSTD,    -5 },
+    { "zstd 1",          CODEC_ZSTD,    1  },
+    { "zstd 3",          CODEC_ZSTD,    3  },
+    { "zstd 9",          CODEC_ZSTD,    9  },
+    { "zstd 19",         CODEC_ZSTD,    19 },
+    { "palette zstd -5", CODEC_PALETTE, -5 },
+    { "palette zstd 1",  CODEC_PALETTE, 1  },
+    { "palette zstd 3",  CODEC_PALETTE, 3  },
+    { "palette zstd 9",  CODEC_PALETTE, 9  },
+    { "palette zstd 19", CODEC_PALETTE, 19 },
+  };
+
+  f64 freq = (f64)sys_get_performance_frequency();
+  game_dbg_print("codec benchmark, %zu chunks (%.1f MB) from the sample worlds",
+    num_chunks, (f64)(num_chunks * chunk_size) / WT_MEGABYTES(1));
+
+  for (usize i = 0; i < WT_ARRAY_COUNT(configs) && num_chunks > 0; ++i)
+  {
+    usize total_size = 0;
+    u64 compress_ticks = 0, decompress_ticks = 0;
+    bool ok = true;
+    for (usize c = 0; c < num_chunks; ++c)
+    {
+      byte_t *chunk = chunks + c * chunk_size;
+
+      u64 begin = sys_get_performance_counter();
+      usize size = compress_with(configs[i].codec, configs[i].level, cmp_buf, cmp_buf_size, chunk,
+        chunk_size);
+      u64 mid = sys_get_performance_counter();
+      usize out_size = codec_decompress(configs[i].codec, out_buf, chunk_size, cmp_buf, size);
+      u64 end = sys_get_performance_counter();
+
+      ok = ok && size > 0 && out_size == chunk_size && memcmp(out_buf, chunk, chunk_size) == 0;
+      total_size += size;
+      compress_ticks += mid - begin;
+      decompress_ticks += end - mid;
+    }
+
+    f64 mb = (f64)(num_chunks * chunk_size) / WT_MEGABYTES(1);
+    game_dbg_print("  %-15s ratio %6.1f %8.1f B/chunk  in %7.1f MB/s  out %7.1f MB/s%s",
+      configs[i].name, (f64)(num_chunks * chunk_size) / (f64)total_size,
+      (f64)total_size / (f64)num_chunks, mb / ((f64)compress_ticks / freq),
+      mb / ((f64)decompress_ticks / freq), ok ? "" : "  (round trip failed!)");
+  }
+  mem_scratch_end();
+}
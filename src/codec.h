@@ -0,0 +1,44 @@
+#ifndef CODEC_H
+#define CODEC_H
+
+#include <wt/wt.h>
+
+// compressed chunks carry the id of the codec that produced them, so the codec can be picked
+// per use case without breaking anything that's already on disk
+typedef enum
+{
+  CODEC_ZSTD, // has to stay 0, chunks saved before codec ids existed are zstd
+  CODEC_RLE,  // runs of blocks, very fast both ways but bigger than zstd
+  CODEC_RAW,
+  CODEC_PALETTE, // palette with bit-packed indices or vertical runs, then zstd
+  CODEC_MAX,
+} codec_id_t;
+
+typedef enum
+{
+  CODEC_PROFILE_STASH, // chunks evicted to memory, they go in and out all the time
+  CODEC_PROFILE_SAVE,  // chunks written to region files
+  CODEC_PROFILE_NETWORK, // chunks sent to another machine, once there's a network layer to send them
+  CODEC_PROFILE_MAX,
+} codec_profile_t;
+
+// chunks with more different blocks than this can't be palette encoded
+#define CODEC_PALETTE_MAX_SIZE 4096
+
+// zstd levels for each profile that uses it, negative levels trade ratio for lz4-like speed
+#define CODEC_ZSTD_STASH_LEVEL 1
+#define CODEC_ZSTD_SAVE_LEVEL 9
+
+void  codec_init(void);
+
+// safe to call from any thread. dst has to fit ZSTD_compressBound(src_size), anything that
+// doesn't compress is stored raw. both return 0 on failure
+usize codec_compress(codec_profile_t profile, void *dst, usize dst_size, const void *src,
+  usize src_size, codec_id_t *codec);
+usize codec_decompress(codec_id_t codec, void *dst, usize dst_size, const void *src,
+  usize src_size);
+
+// shows the ratio and speed of every codec on the sample worlds, see game_dbg_print
+void  codec_dbg_benchmark(void);
+
+#endif
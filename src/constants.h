@@ -27,6 +27,22 @@
 
 #define CHUNK_NUM_BLOCKS (CHUNK_SIZE_X * CHUNK_SIZE_Y * CHUNK_SIZE_Z)
 
+// chunks are meshed in sections this tall, so an edit only remeshes the sections it touches
+#define CHUNK_SECTION_SIZE_Y 16
+#define CHUNK_NUM_SECTIONS (CHUNK_SIZE_Y / CHUNK_SECTION_SIZE_Y)
+#define CHUNK_SECTION_NUM_BLOCKS (CHUNK_SIZE_X * CHUNK_SECTION_SIZE_Y * CHUNK_SIZE_Z)
+
+// chunks are a power of two across, so world positions split into chunk and block with shifts
+#define CHUNK_SHIFT_X 4
+#define CHUNK_SHIFT_Z 4
+
+// radius (in chunks) around the player that is kept loaded
+#define VIEW_DISTANCE 12
+
+// how much memory resident chunks may take up. chunks outside of every ticket stay around as a
+// cache until the budget runs out, then the least recently used ones are evicted
+#define CHUNK_MEMORY_BUDGET WT_MEGABYTES(256)
+
 #define WINDOW_NAME "voxel game"
 
 #endif
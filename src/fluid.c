@@ -0,0 +1,608 @@
+#include "fluid.h"
+#include "game.h"
+#include "memory.h"
+#include "system.h"
+#include "world.h"
+#include "constants.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define FLUID_NONE 0xffffffffu
+
+// what cells outside ready chunks read as, nothing flows into or out of them
+#define FLUID_WALL ((block_id_t)-1)
+
+// the benchmark's basin, with its walls and floor and room above for the sources
+#define FLUID_BENCHMARK_VOLUME_X (FLUID_BENCHMARK_SIZE + 2)
+#define FLUID_BENCHMARK_VOLUME_Y (FLUID_BENCHMARK_DEPTH + 2)
+#define FLUID_BENCHMARK_VOLUME_Z (FLUID_BENCHMARK_SIZE + 2)
+
+static const block_id_t k_sources[FLUID_COUNT] = { BLOCK_WATER, BLOCK_LAVA };
+static const i32 k_spread[FLUID_COUNT] = { 1, 2 }; // levels lost flowing sideways a block
+static const u32 k_rates[FLUID_COUNT] = { FLUID_WATER_RATE, FLUID_LAVA_RATE };
+
+static const wt_vec3_t k_dirs[] = { { 0, -1, 0 }, { 0, 1, 0 }, { -1, 0, 0 }, { 1, 0, 0 }, { 0, 0, -1 }, { 0, 0, 1 } };
+
+// a cell depends on the blocks next to it and the ones under its sideways neighbors, so a change
+// can set these going
+static const wt_vec3_t k_affected[] = {
+  { 0, 0, 0 }, { 0, -1, 0 }, { 0, 1, 0 }, { -1, 0, 0 }, { 1, 0, 0 }, { 0, 0, -1 }, { 0, 0, 1 },
+  { -1, 1, 0 }, { 1, 1, 0 }, { 0, 1, -1 }, { 0, 1, 1 },
+};
+
+// active cells are block indices within their chunk, which fit in 16 bits
+typedef struct
+{
+  u32 next;
+  u32 count;
+  u16 cells[FLUID_PAGE_SIZE];
+} fluid_page_t;
+
+// the cells of a fluid that might change on its next step. cells can be in there more than once
+typedef struct
+{
+  u32 first_page[WORLD_MAX_CHUNKS];
+  u16 chunks[WORLD_MAX_CHUNKS]; // that have any cells, in the order they got them
+  usize num_chunks;
+  usize num_cells;
+} fluid_list_t;
+
+typedef struct
+{
+  fluid_page_t *pages;
+  u32 free_page;
+  fluid_list_t lists[FLUID_COUNT];
+
+  // sections that have had a fluid in them since their chunk got ready. edits anywhere else can't
+  // set anything flowing
+  u16 sections[WORLD_MAX_CHUNKS];
+
+  // while the benchmark runs, fluids step through its blocks instead of the world's
+  block_id_t *volume;
+} fluid_state_t;
+
+static fluid_state_t *get_state(void)
+{
+  return game_get_state()->modules.fluid;
+}
+
+void fluid_init(void)
+{
+  game_state_t *gs = game_get_state();
+  fluid_state_t *s = gs->modules.fluid = mem_hunk_push(sizeof(fluid_state_t));
+
+  s->pages = mem_hunk_push(FLUID_MAX_PAGES * sizeof(fluid_page_t));
+  for (u32 i = 0; i < FLUID_MAX_PAGES; ++i)
+  {
+    s->pages[i].next = i + 1 < FLUID_MAX_PAGES ? i + 1 : FLUID_NONE;
+  }
+  for (usize i = 0; i < FLUID_COUNT; ++i)
+  {
+    memset(s->lists[i].first_page, 0xff, sizeof(s->lists[i].first_page));
+  }
+}
+
+usize fluid_get_num_active(usize fluid)
+{
+  return get_state()->lists[fluid].num_cells;
+}
+
+static usize chunk_index(wt_vec3_t pos)
+{
+  return (pos.x >> CHUNK_SHIFT_X) + (pos.z >> CHUNK_SHIFT_Z) * WORLD_MAX_CHUNKS_X;
+}
+
+static usize block_index(wt_vec3_t pos)
+{
+  return (pos.x & (CHUNK_SIZE_X - 1)) | ((pos.z & (CHUNK_SIZE_Z - 1)) << CHUNK_SHIFT_X) |
+    (pos.y << (CHUNK_SHIFT_X + CHUNK_SHIFT_Z));
+}
+
+static void activate(fluid_list_t *l, wt_vec3_t pos)
+{
+  fluid_state_t *s = get_state();
+  if (!world_within_bounds(pos))
+  {
+    return;
+  }
+
+  usize chunk = chunk_index(pos);
+  u32 *head = &l->first_page[chunk];
+  if (*head == FLUID_NONE || s->pages[*head].count == FLUID_PAGE_SIZE)
+  {
+    if (s->free_page == FLUID_NONE)
+    {
+      return;
+    }
+    if (*head == FLUID_NONE)
+    {
+      l->chunks[l->num_chunks++] = chunk;
+    }
+
+    u32 page = s->free_page;
+    s->free_page = s->pages[page].next;
+    s->pages[page].next = *head;
+    s->pages[page].count = 0;
+    *head = page;
+  }
+
+  fluid_page_t *p = &s->pages[*head];
+  p->cells[p->count++] = block_index(pos);
+  ++l->num_cells;
+}
+
+static void activate_around(wt_vec3_t pos)
+{
+  fluid_state_t *s = get_state();
+  for (usize i = 0; i < FLUID_COUNT; ++i)
+  {
+    for (usize j = 0; j < WT_ARRAY_COUNT(k_affected); ++j)
+    {
+      activate(&s->lists[i], wt_vec3i_add(pos, k_affected[j]));
+    }
+  }
+}
+
+static usize volume_index(wt_vec3_t pos)
+{
+  return pos.x + pos.z * FLUID_BENCHMARK_VOLUME_X +
+    pos.y * FLUID_BENCHMARK_VOLUME_X * FLUID_BENCHMARK_VOLUME_Z;
+}
+
+static block_id_t read_block(wt_vec3_t pos)
+{
+  fluid_state_t *s = get_state();
+  if (s->volume)
+  {
+    bool inside = (u32)pos.x < FLUID_BENCHMARK_VOLUME_X && (u32)pos.y < FLUID_BENCHMARK_VOLUME_Y &&
+      (u32)pos.z < FLUID_BENCHMARK_VOLUME_Z;
+    return inside ? s->volume[volume_index(pos)] : FLUID_WALL;
+  }
+
+  if (pos.y < 0 || pos.y >= CHUNK_SIZE_Y)
+  {
+    return FLUID_WALL;
+  }
+
+  chunk_t *c = world_get_chunk(wt_vec2(pos.x >> CHUNK_SHIFT_X, pos.z >> CHUNK_SHIFT_Z));
+  return c && c->status == CHUNK_STATUS_READY ? c->data->blocks[block_index(pos)] : FLUID_WALL;
+}
+
+// -1 if it isn't one
+static i32 fluid_of(block_id_t block)
+{
+  for (usize i = 0; i < FLUID_COUNT; ++i)
+  {
+    if (block >= k_sources[i] && block < k_sources[i] + BLOCK_FLUID_LEVELS)
+    {
+      return i;
+    }
+  }
+  return -1;
+}
+
+// what the fluid can flow into
+static bool replaceable(block_id_t block, usize fluid)
+{
+  return block == BLOCK_AIR || (fluid_of(block) == (i32)fluid && block != k_sources[fluid]);
+}
+
+static block_id_t next_state(usize fluid, wt_vec3_t pos, block_id_t block)
+{
+  block_id_t source = k_sources[fluid];
+  if (block != BLOCK_AIR && fluid_of(block) != (i32)fluid)
+  {
+    return block;
+  }
+
+  // lava hardens where it touches water
+  if (fluid == FLUID_LAVA && block != BLOCK_AIR)
+  {
+    for (usize dir = 0; dir < WT_ARRAY_COUNT(k_dirs); ++dir)
+    {
+      if (fluid_of(read_block(wt_vec3i_add(pos, k_dirs[dir]))) == FLUID_WATER)
+      {
+        return BLOCK_COBBLESTONE;
+      }
+    }
+  }
+
+  if (block == source)
+  {
+    return block;
+  }
+
+  // fed by the strongest neighbor that isn't falling
+  i32 level = BLOCK_FLUID_LEVELS;
+  usize num_sources = 0;
+  for (usize dir = 2; dir < WT_ARRAY_COUNT(k_dirs); ++dir)
+  {
+    wt_vec3_t n = wt_vec3i_add(pos, k_dirs[dir]);
+    block_id_t b = read_block(n);
+    if (fluid_of(b) != (i32)fluid)
+    {
+      continue;
+    }
+
+    num_sources += b == source;
+    if (!replaceable(read_block(wt_vec3(n.x, n.y - 1, n.z)), fluid))
+    {
+      level = WT_MIN(level, (i32)(b - source) + k_spread[fluid]);
+    }
+  }
+
+  if (fluid == FLUID_WATER && num_sources >= 2 &&
+    !replaceable(read_block(wt_vec3(pos.x, pos.y - 1, pos.z)), fluid))
+  {
+    return source;
+  }
+  if (fluid_of(read_block(wt_vec3(pos.x, pos.y + 1, pos.z))) == (i32)fluid)
+  {
+    return source + 1;
+  }
+  return level < BLOCK_FLUID_LEVELS ? source + level : BLOCK_AIR;
+}
+
+static int compare_u64(const void *a, const void *b)
+{
+  u64 x = *(const u64*)a;
+  u64 y = *(const u64*)b;
+  return (x > y) - (x < y);
+}
+
+static int compare_u16(const void *a, const void *b)
+{
+  return (i32)*(const u16*)a - (i32)*(const u16*)b;
+}
+
+void fluid_step(usize fluid)
+{
+  fluid_state_t *s = get_state();
+  fluid_list_t *l = &s->lists[fluid];
+  if (!l->num_chunks)
+  {
+    return;
+  }
+
+  // the list is taken over, whatever this step changes starts a new one
+  mem_scratch_begin();
+  usize num_chunks = l->num_chunks;
+  usize num_cells = l->num_cells;
+  u64 *heads = mem_scratch_push(num_chunks * sizeof(u64));
+  for (usize i = 0; i < num_chunks; ++i)
+  {
+    heads[i] = ((u64)l->chunks[i] << 32) | l->first_page[l->chunks[i]];
+    l->first_page[l->chunks[i]] = FLUID_NONE;
+  }
+  l->num_chunks = 0;
+  l->num_cells = 0;
+
+  // chunk by chunk and cell by cell in index order, so a step always comes out the same
+  qsort(heads, num_chunks, sizeof(u64), compare_u64);
+
+  u16 *cells = mem_scratch_push(num_cells * sizeof(u16));
+  world_edit_t *edits = mem_scratch_push(num_cells * sizeof(world_edit_t));
+  usize num_edits = 0;
+  for (usize i = 0; i < num_chunks; ++i)
+  {
+    usize chunk = heads[i] >> 32;
+    u32 page = (u32)heads[i];
+    usize n = 0;
+    while (page != FLUID_NONE)
+    {
+      fluid_page_t *p = &s->pages[page];
+      memcpy(cells + n, p->cells, p->count * sizeof(u16));
+      n += p->count;
+
+      u32 next = p->next;
+      p->next = s->free_page;
+      s->free_page = page;
+      page = next;
+    }
+
+    wt_vec2_t chunk_pos = wt_vec2(chunk % WORLD_MAX_CHUNKS_X, chunk / WORLD_MAX_CHUNKS_X);
+    chunk_t *c = world_get_chunk(chunk_pos);
+    if (!s->volume && (!c || c->status != CHUNK_STATUS_READY))
+    {
+      continue;
+    }
+
+    qsort(cells, n, sizeof(u16), compare_u16);
+    wt_vec3_t origin = wt_vec3(chunk_pos.x * CHUNK_SIZE_X, 0, chunk_pos.y * CHUNK_SIZE_Z);
+    for (usize j = 0; j < n; ++j)
+    {
+      if (j > 0 && cells[j] == cells[j - 1])
+      {
+        continue;
+      }
+
+      u16 idx = cells[j];
+      wt_vec3_t pos = wt_vec3(origin.x + (idx & (CHUNK_SIZE_X - 1)), idx >> (CHUNK_SHIFT_X + CHUNK_SHIFT_Z),
+        origin.z + ((idx >> CHUNK_SHIFT_X) & (CHUNK_SIZE_Z - 1)));
+      block_id_t block = s->volume ? read_block(pos) : c->data->blocks[idx];
+      block_id_t next = next_state(fluid, pos, block);
+      if (next != block)
+      {
+        edits[num_edits++] = (world_edit_t){ pos, next };
+      }
+    }
+  }
+
+  // every cell was worked out from how things were before the step. the changes go in as one bulk
+  // edit per chunk, which marks each section that needs remeshing once and sets what's around
+  // them going for the next step
+  if (s->volume)
+  {
+    for (usize i = 0; i < num_edits; ++i)
+    {
+      s->volume[volume_index(edits[i].pos)] = edits[i].block;
+      activate_around(edits[i].pos);
+    }
+  }
+  else
+  {
+    world_set_blocks(edits, num_edits);
+  }
+  mem_scratch_end();
+}
+
+void fluid_tick(u64 tick)
+{
+  for (usize i = 0; i < FLUID_COUNT; ++i)
+  {
+    if (tick % k_rates[i] == 0)
+    {
+      fluid_step(i);
+    }
+  }
+}
+
+// whether a fluid is right next to pos
+static bool near_fluid(wt_vec3_t pos)
+{
+  fluid_state_t *s = get_state();
+  const u8 *flags = block_get_flags();
+
+  // away from the sides of its chunk, the sections above and below are all that need a look
+  u32 sections = (1u << (WT_MAX(pos.y - 1, 0) / CHUNK_SECTION_SIZE_Y)) |
+    (1u << ((pos.y + 1) / CHUNK_SECTION_SIZE_Y));
+  i32 x = pos.x & (CHUNK_SIZE_X - 1);
+  i32 z = pos.z & (CHUNK_SIZE_Z - 1);
+  if (x > 0 && x < CHUNK_SIZE_X - 1 && z > 0 && z < CHUNK_SIZE_Z - 1 && !(s->sections[chunk_index(pos)] & sections))
+  {
+    return false;
+  }
+
+  for (usize dir = 0; dir < WT_ARRAY_COUNT(k_dirs); ++dir)
+  {
+    wt_vec3_t n = wt_vec3i_add(pos, k_dirs[dir]);
+    if (!world_within_bounds(n) || !(s->sections[chunk_index(n)] & (1u << (n.y / CHUNK_SECTION_SIZE_Y))))
+    {
+      continue;
+    }
+
+    block_id_t block = read_block(n);
+    if (block != FLUID_WALL && (flags[block] & BLOCK_FLAG_FLUID))
+    {
+      return true;
+    }
+  }
+  return false;
+}
+
+void fluid_block_changed(wt_vec3_t pos, block_id_t old_block, block_id_t block)
+{
+  fluid_state_t *s = get_state();
+  const u8 *flags = block_get_flags();
+  if (flags[block] & BLOCK_FLAG_FLUID)
+  {
+    s->sections[chunk_index(pos)] |= 1u << (pos.y / CHUNK_SECTION_SIZE_Y);
+  }
+
+  if (((flags[old_block] | flags[block]) & BLOCK_FLAG_FLUID) || near_fluid(pos))
+  {
+    activate_around(pos);
+  }
+}
+
+void fluid_scan_chunk(chunk_t *c)
+{
+  const u8 *flags = block_get_flags();
+  c->fluid_sections = 0;
+  for (usize i = 0; i < CHUNK_NUM_BLOCKS; ++i)
+  {
+    if (flags[c->data->blocks[i]] & BLOCK_FLAG_FLUID)
+    {
+      c->fluid_sections |= 1u << (i / CHUNK_SECTION_NUM_BLOCKS);
+    }
+  }
+}
+
+// fluid on either side of the border with a neighbor that was ready first saw a wall there, so it
+// might flow across now
+static void activate_border(chunk_t *c, wt_vec2_t side)
+{
+  fluid_state_t *s = get_state();
+  const u8 *flags = block_get_flags();
+  chunk_t *n = world_get_chunk(wt_vec2i_add(c->position, side));
+  if (!n || n->status != CHUNK_STATUS_READY)
+  {
+    return;
+  }
+
+  u32 sections = s->sections[c->position.x + c->position.y * WORLD_MAX_CHUNKS_X] |
+    s->sections[n->position.x + n->position.y * WORLD_MAX_CHUNKS_X];
+  wt_vec3_t origin = wt_vec3(c->position.x * CHUNK_SIZE_X, 0, c->position.y * CHUNK_SIZE_Z);
+  for (usize section = 0; section < CHUNK_NUM_SECTIONS; ++section)
+  {
+    if (!(sections & (1u << section)))
+    {
+      continue;
+    }
+
+    for (i32 y = section * CHUNK_SECTION_SIZE_Y; y < (i32)(section + 1) * CHUNK_SECTION_SIZE_Y; ++y)
+    {
+      for (i32 i = 0; i < CHUNK_SIZE_X; ++i)
+      {
+        wt_vec3_t a = origin;
+        a.y = y;
+        if (side.x)
+        {
+          a.x += side.x < 0 ? 0 : CHUNK_SIZE_X - 1;
+          a.z += i;
+        }
+        else
+        {
+          a.x += i;
+          a.z += side.y < 0 ? 0 : CHUNK_SIZE_Z - 1;
+        }
+        wt_vec3_t b = wt_vec3(a.x + side.x, y, a.z + side.y);
+
+        if ((flags[c->data->blocks[block_index(a)]] | flags[n->data->blocks[block_index(b)]]) &
+          BLOCK_FLAG_FLUID)
+        {
+          activate_around(a);
+          activate_around(b);
+        }
+      }
+    }
+  }
+}
+
+void fluid_chunk_ready(chunk_t *c)
+{
+  static const wt_vec2_t k_neighbors[] = { { -1, 0 }, { 1, 0 }, { 0, -1 }, { 0, 1 } };
+  fluid_state_t *s = get_state();
+  const u8 *flags = block_get_flags();
+  usize chunk = c->position.x + c->position.y * WORLD_MAX_CHUNKS_X;
+  wt_vec3_t origin = wt_vec3(c->position.x * CHUNK_SIZE_X, 0, c->position.y * CHUNK_SIZE_Z);
+
+  // fluid that was still flowing when the chunk was saved carries on, the load job found the
+  // sections it's in
+  s->sections[chunk] = c->fluid_sections;
+  for (usize section = 0; section < CHUNK_NUM_SECTIONS; ++section)
+  {
+    if (!(c->fluid_sections & (1u << section)))
+    {
+      continue;
+    }
+
+    usize end = (section + 1) * CHUNK_SECTION_NUM_BLOCKS;
+    for (usize i = section * CHUNK_SECTION_NUM_BLOCKS; i < end; ++i)
+    {
+      block_id_t block = c->data->blocks[i];
+      if ((flags[block] & BLOCK_FLAG_FLUID) && block != k_sources[fluid_of(block)])
+      {
+        activate(&s->lists[fluid_of(block)], wt_vec3(origin.x + (i & (CHUNK_SIZE_X - 1)),
+          i >> (CHUNK_SHIFT_X + CHUNK_SHIFT_Z),
+          origin.z + ((i >> CHUNK_SHIFT_X) & (CHUNK_SIZE_Z - 1))));
+      }
+    }
+  }
+
+  for (usize side = 0; side < WT_ARRAY_COUNT(k_neighbors); ++side)
+  {
+    activate_border(c, k_neighbors[side]);
+  }
+}
+
+// gives back the pages of lists the benchmark left cells in
+static void free_lists(fluid_list_t *lists)
+{
+  fluid_state_t *s = get_state();
+  for (usize i = 0; i < FLUID_COUNT; ++i)
+  {
+    for (usize j = 0; j < lists[i].num_chunks; ++j)
+    {
+      u32 page = lists[i].first_page[lists[i].chunks[j]];
+      while (page != FLUID_NONE)
+      {
+        u32 next = s->pages[page].next;
+        s->pages[page].next = s->free_page;
+        s->free_page = page;
+        page = next;
+      }
+    }
+  }
+}
+
+void fluid_dbg_benchmark(void)
+{
+  fluid_state_t *s = get_state();
+  f64 freq = (f64)sys_get_performance_frequency();
+
+  // the world's fluids are put aside, the benchmark has lists of its own
+  mem_scratch_begin();
+  fluid_list_t *world_lists = mem_scratch_push(sizeof(s->lists));
+  memcpy(world_lists, s->lists, sizeof(s->lists));
+  for (usize i = 0; i < FLUID_COUNT; ++i)
+  {
+    memset(s->lists[i].first_page, 0xff, sizeof(s->lists[i].first_page));
+    s->lists[i].num_chunks = 0;
+    s->lists[i].num_cells = 0;
+  }
+
+  // a cobblestone basin open to the sky
+  s->volume = mem_scratch_push(FLUID_BENCHMARK_VOLUME_X * FLUID_BENCHMARK_VOLUME_Y *
+    FLUID_BENCHMARK_VOLUME_Z * sizeof(block_id_t));
+  for (i32 y = 0; y < FLUID_BENCHMARK_VOLUME_Y; ++y)
+  {
+    for (i32 z = 0; z < FLUID_BENCHMARK_VOLUME_Z; ++z)
+    {
+      for (i32 x = 0; x < FLUID_BENCHMARK_VOLUME_X; ++x)
+      {
+        bool wall = y == 0 || x == 0 || z == 0 || x == FLUID_BENCHMARK_VOLUME_X - 1 ||
+          z == FLUID_BENCHMARK_VOLUME_Z - 1;
+        s->volume[volume_index(wt_vec3(x, y, z))] = wall ? BLOCK_COBBLESTONE : BLOCK_AIR;
+      }
+    }
+  }
+
+  // sources down two of its walls fill the bottom layer, then each one above it
+  for (i32 y = 1; y <= FLUID_BENCHMARK_DEPTH; ++y)
+  {
+    for (i32 i = 1; i <= FLUID_BENCHMARK_SIZE; ++i)
+    {
+      wt_vec3_t a = wt_vec3(i, y, 1);
+      wt_vec3_t b = wt_vec3(1, y, i);
+      s->volume[volume_index(a)] = BLOCK_WATER;
+      s->volume[volume_index(b)] = BLOCK_WATER;
+      activate_around(a);
+      activate_around(b);
+    }
+  }
+
+  usize num_steps = 0;
+  usize num_cells = 0;
+  u64 begin = sys_get_performance_counter();
+  while (fluid_get_num_active(FLUID_WATER) && num_steps < FLUID_BENCHMARK_MAX_STEPS)
+  {
+    num_cells += fluid_get_num_active(FLUID_WATER);
+    fluid_step(FLUID_WATER);
+    ++num_steps;
+  }
+  u64 end = sys_get_performance_counter();
+
+  usize num_sources = 0;
+  for (i32 y = 1; y <= FLUID_BENCHMARK_DEPTH; ++y)
+  {
+    for (i32 z = 1; z <= FLUID_BENCHMARK_SIZE; ++z)
+    {
+      for (i32 x = 1; x <= FLUID_BENCHMARK_SIZE; ++x)
+      {
+        num_sources += s->volume[volume_index(wt_vec3(x, y, z))] == BLOCK_WATER;
+      }
+    }
+  }
+
+  free_lists(s->lists);
+  memcpy(s->lists, world_lists, sizeof(s->lists));
+  s->volume = NULL;
+  mem_scratch_end();
+
+  f64 seconds = (f64)(end - begin) / freq;
+  game_dbg_print("fluid: %zu steps in %.1f ms, %.1f us/step, %.1f ns/active cell", num_steps,
+    seconds * 1e3, seconds * 1e6 / WT_MAX(num_steps, 1), seconds * 1e9 / WT_MAX(num_cells, 1));
+  game_dbg_print("fluid: %zu of %d blocks flooded", num_sources,
+    FLUID_BENCHMARK_SIZE * FLUID_BENCHMARK_SIZE * FLUID_BENCHMARK_DEPTH);
+}
@@ -0,0 +1,46 @@
+#ifndef FLUID_H
+#define FLUID_H
+
+#include <wt/wt.h>
+#include "block.h"
+#include "chunk.h"
+
+// fluids flow a level at a time out of their source blocks (see BLOCK_FLUID_LEVELS), straight down
+// and then sideways once there's something under them. water between two sources becomes one
+#define FLUID_WATER 0
+#define FLUID_LAVA 1
+#define FLUID_COUNT 2
+
+// block ticks between each step of a fluid, see tick.h
+#define FLUID_WATER_RATE 5
+#define FLUID_LAVA_RATE 15
+
+// only cells that might change are looked at on a step, they're kept in lists of pages per chunk.
+// once the pages run out, cells set flowing are dropped until some free up
+#define FLUID_PAGE_SIZE 1024
+#define FLUID_MAX_PAGES 8192
+
+#define FLUID_BENCHMARK_SIZE 48
+#define FLUID_BENCHMARK_DEPTH 16
+#define FLUID_BENCHMARK_MAX_STEPS 4096
+
+void  fluid_init(void);
+
+// steps whichever fluids are due on the block tick
+void  fluid_tick(u64 tick);
+void  fluid_step(usize fluid);
+usize fluid_get_num_active(usize fluid);
+
+// called by the world for every block that changes, and every chunk that gets ready
+void  fluid_block_changed(wt_vec3_t pos, block_id_t old_block, block_id_t block);
+void  fluid_chunk_ready(chunk_t *c);
+
+// finds the sections of a loading chunk with fluid in them, so fluid_chunk_ready only looks through
+// those. safe to call from jobs, as long as nothing else writes the chunk
+void  fluid_scan_chunk(chunk_t *c);
+
+// floods a basin of its own that isn't part of the world, stepping the water until it settles.
+// the results go to game_dbg_print
+void  fluid_dbg_benchmark(void);
+
+#endif
@@ -8,6 +8,13 @@
 #include "job.h"
 #include "chunk.h"
 #include "world.h"
+#include "region.h"
+#include "codec.h"
+#include "journal.h"
+#include "meshcache.h"
+#include "light.h"
+#include "tick.h"
+#include "fluid.h"
 #include "player.h"
 #include <math.h>
 #include <stdio.h>
@@ -52,67 +59,33 @@ void game_init(game_state_t *s)
 
   block_mgr_init();
   chunk_init();
+  codec_init();
+  region_init();
+  journal_init();
+  light_init();
+  tick_init();
+  fluid_init();
   world_init();
 
+  // chunks that weren't saved get generated as they're streamed in. the player spawns in a corner
+  // of the world, so it has to be loaded first. a world that can't be read is replaced with a new
+  // one, rather than generating the missing chunks from the wrong seed
+  if (!world_load())
+  {
+    game_dbg_print("no world to load, generating a new one");
+    world_generate(WORLD_DEFAULT_SEED);
+  }
   player_init();
 
-  block_info_t blocks_info[] = {
-    { "Air",
-      { wt_vec2(0, 0), wt_vec2(0, 0), wt_vec2(0, 0), wt_vec2(0, 0), wt_vec2(0, 0), wt_vec2(0, 0) },
-      false },
-    { "Dirt",
-      { wt_vec2(1, 0), wt_vec2(1, 0), wt_vec2(1, 0), wt_vec2(1, 0), wt_vec2(1, 0), wt_vec2(1, 0) },
-      true  },
-    { "Grass Block",
-      { wt_vec2(3, 0), wt_vec2(1, 0), wt_vec2(2, 0), wt_vec2(2, 0), wt_vec2(2, 0), wt_vec2(2, 0) },
-      true  },
-    { "Planks",
-      { wt_vec2(1, 1), wt_vec2(1, 1), wt_vec2(1, 1), wt_vec2(1, 1), wt_vec2(1, 1), wt_vec2(1, 1) },
-      true  },
-    { "Cobblestone",
-      { wt_vec2(2, 1), wt_vec2(2, 1), wt_vec2(2, 1), wt_vec2(2, 1), wt_vec2(2, 1), wt_vec2(2, 1) },
-      true  },
-    { "Stone Tile",
-      { wt_vec2(3, 1), wt_vec2(3, 1), wt_vec2(3, 1), wt_vec2(3, 1), wt_vec2(3, 1), wt_vec2(3, 1) },
-      true  },
-    { "Log",
-      { wt_vec2(4, 0), wt_vec2(4, 0), wt_vec2(4, 1), wt_vec2(4, 1), wt_vec2(4, 1), wt_vec2(4, 1) },
-      true  },
-    { "Leaves",
-      { wt_vec2(5, 0), wt_vec2(5, 0), wt_vec2(5, 0), wt_vec2(5, 0), wt_vec2(5, 0), wt_vec2(5, 0) },
-      false },
-
-    { "White Cloth",
-      { wt_vec2(1, 3), wt_vec2(1, 3), wt_vec2(1, 3), wt_vec2(1, 3), wt_vec2(1, 3), wt_vec2(1, 3) },
-      true },
-    { "Red Cloth",
-      { wt_vec2(2, 3), wt_vec2(2, 3), wt_vec2(2, 3), wt_vec2(2, 3), wt_vec2(2, 3), wt_vec2(2, 3) },
-      true },
-    { "Orange Cloth",
-      { wt_vec2(3, 3), wt_vec2(3, 3), wt_vec2(3, 3), wt_vec2(3, 3), wt_vec2(3, 3), wt_vec2(3, 3) },
-      true },
-    { "Yellow Cloth",
-      { wt_vec2(4, 3), wt_vec2(4, 3), wt_vec2(4, 3), wt_vec2(4, 3), wt_vec2(4, 3), wt_vec2(4, 3) },
-      true },
-    { "Green Cloth",
-      { wt_vec2(5, 3), wt_vec2(5, 3), wt_vec2(5, 3), wt_vec2(5, 3), wt_vec2(5, 3), wt_vec2(5, 3) },
-      true },
-    { "Blue Cloth",
-      { wt_vec2(6, 3), wt_vec2(6, 3), wt_vec2(6, 3), wt_vec2(6, 3), wt_vec2(6, 3), wt_vec2(6, 3) },
-      true },
-    { "Purple Cloth",
-      { wt_vec2(7, 3), wt_vec2(7, 3), wt_vec2(7, 3), wt_vec2(7, 3), wt_vec2(7, 3), wt_vec2(7, 3) },
-      true },
-    { "Black Cloth",
-      { wt_vec2(8, 3), wt_vec2(8, 3), wt_vec2(8, 3), wt_vec2(8, 3), wt_vec2(8, 3), wt_vec2(8, 3) },
-      true },
-  };
-
-  for (usize i = 0; i < WT_ARRAY_COUNT(blocks_info); ++i)
+  // the built in blocks are registered by block_mgr_init, see BLOCK_BUILTINS
+  for (usize i = 0; i < BLOCK_MAX; ++i)
   {
-    s->blocks[i] = block_new(&blocks_info[i]);
+    s->blocks[i] = i;
   }
 
+  // cached meshes are only any good for the blocks they were made with
+  meshcache_init();
+
   s->debug_font = ren_texture_load_from_file("data/sprites/debug-font.png");
 
 #if 0
@@ -138,10 +111,35 @@ void game_init(game_state_t *s)
   s->hotbar[13] = s->blocks[BLOCK_CLOTH_PURPLE];
   s->hotbar[14] = s->blocks[BLOCK_CLOTH_BLACK];
 
-  if (!world_load())
+  s->hotbar[15] = s->blocks[BLOCK_LAMP];
+  s->hotbar[16] = s->blocks[BLOCK_WATER];
+  s->hotbar[17] = s->blocks[BLOCK_LAVA];
+}
+
+typedef struct
+{
+  wt_vec3_t origin;
+  i32 radius;
+} sphere_t;
+
+// every block within the radius of the origin
+static bool sphere_row(i32 y, i32 z, i32 *x_begin, i32 *x_end, void *user)
+{
+  sphere_t *sphere = user;
+  i32 dy = y - sphere->origin.y;
+  i32 dz = z - sphere->origin.z;
+  i32 rem = sphere->radius * sphere->radius - dy * dy - dz * dz;
+  if (rem < 0)
   {
-    world_generate();
+    return false;
   }
+
+  i32 half = (i32)sqrtf((f32)rem);
+  while ((half + 1) * (half + 1) <= rem) { ++half; }
+  while (half * half > rem)             { --half; }
+  *x_begin = sphere->origin.x - half;
+  *x_end = sphere->origin.x + half + 1;
+  return true;
 }
 
 static void game_render(void);
@@ -168,12 +166,13 @@ bool game_tick(game_state_t *s)
 #else
   if (sys_key_pressed(SYS_KEYCODE_G))
   {
-    world_generate();
+    world_generate(rng_next());
   }
 
   job_tick();
 
   player_tick();
+  world_tick();
 
   i32 mouse_wheel = sys_mouse_get_wheel();
   if (mouse_wheel != 0)
@@ -209,32 +208,10 @@ bool game_tick(game_state_t *s)
     world_raycast_t rc = world_raycast(10000);
     if (rc.hit)
     {
-      wt_vec3_t origin = rc.pos;
-      const int radius = 50;
-
-      wt_vec3_t begin = wt_vec3i_sub_i32(origin, radius);
-      wt_vec3_t end = wt_vec3i_add_i32(origin, radius);
-
-      for (int z = begin.z; z < end.z; ++z)
-      {
-        for (int y = begin.y; y < end.y; ++y)
-        {
-          for (int x = begin.x; x < end.x; ++x)
-          {
-            wt_vec3_t pos = wt_vec3(x, y, z);
-            wt_vec3_t offset = wt_vec3i_sub(pos, origin);
-
-            f32 dist_sq = (f32)(offset.x * offset.x) + (f32)(offset.y * offset.y) +
-              (f32)(offset.z * offset.z);
-            f32 target_dist_sq = (f32)radius * (f32)radius;
-
-            if (world_within_bounds(pos) && dist_sq <= target_dist_sq)
-            {
-              world_set_block(pos, 0);
-            }
-          }
-        }
-      }
+      sphere_t sphere = { rc.pos, 50 };
+      wt_vec3_t begin = wt_vec3i_sub_i32(sphere.origin, sphere.radius);
+      wt_vec3_t end = wt_vec3i_add_i32(sphere.origin, sphere.radius);
+      world_apply_shape(begin, end, sphere_row, &sphere, 0);
     }
   }
 
@@ -248,6 +225,21 @@ bool game_tick(game_state_t *s)
     world_save();
   }
 
+  if (sys_key_pressed(SYS_KEYCODE_B))
+  {
+    codec_dbg_benchmark();
+  }
+
+  if (sys_key_pressed(SYS_KEYCODE_N))
+  {
+    world_dbg_benchmark();
+  }
+
+  if (sys_key_pressed(SYS_KEYCODE_F))
+  {
+    fluid_dbg_benchmark();
+  }
+
   if (sys_key_down(SYS_KEYCODE_ESCAPE))
   {
     return false;
@@ -284,6 +276,16 @@ static void draw_debug_text(wt_vec2_t pos_cells, const char *fmt, ...)
   }
 }
 
+void game_dbg_print(const char *fmt, ...)
+{
+  game_state_t *s = s_state;
+  char *line = s->debug_lines[s->num_debug_lines++ % GAME_DEBUG_LINES];
+  va_list va;
+  va_start(va, fmt);
+  vsnprintf(line, GAME_DEBUG_LINE_SIZE, fmt, va);
+  va_end(va);
+}
+
 static void game_render(void)
 {
   game_state_t *s = s_state;
@@ -320,6 +322,12 @@ static void game_render(void)
     draw_debug_text(wt_vec2(1, 2), "holding: %s", holding_info->name);
   }
 
+  usize first_line = s->num_debug_lines - WT_MIN(s->num_debug_lines, GAME_DEBUG_LINES);
+  for (usize i = first_line; i < s->num_debug_lines; ++i)
+  {
+    draw_debug_text(wt_vec2(1, 4 + i - first_line), "%s", s->debug_lines[i % GAME_DEBUG_LINES]);
+  }
+
   ren_frame_end();
 }
 
@@ -7,7 +7,12 @@
 #include "chunk.h"
 #include "gpu.h"
 
-#define INVENTORY_SIZE BLOCK_MAX
+// a slot for every block that can be placed: not air, and only the source level of each fluid
+#define INVENTORY_SIZE (BLOCK_MAX - 1 - 2 * (BLOCK_FLUID_LEVELS - 1))
+
+// the last few lines printed with game_dbg_print stay on screen under the debug text
+#define GAME_DEBUG_LINES 16
+#define GAME_DEBUG_LINE_SIZE 128
 
 typedef struct
 {
@@ -21,6 +26,13 @@ typedef struct
 
   void *block;
   void *chunk;
+  void *codec;
+  void *region;
+  void *journal;
+  void *meshcache;
+  void *light;
+  void *tick;
+  void *fluid;
   void *world;
 
   void *player;
@@ -51,6 +63,9 @@ typedef struct
 
   block_id_t blocks[BLOCK_MAX];
 
+  char debug_lines[GAME_DEBUG_LINES][GAME_DEBUG_LINE_SIZE];
+  usize num_debug_lines; // printed so far, the lines wrap around
+
   void *hunk;
 } game_state_t;
 
@@ -62,4 +77,7 @@ void game_hot_reload(game_state_t *s);
 
 game_state_t *game_get_state(void);
 
+// main thread only
+void game_dbg_print(const char *fmt, ...);
+
 #endif
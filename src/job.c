@@ -3,11 +3,13 @@
 #include "memory.h"
 #include "system.h"
 #include <immintrin.h>
+#include <string.h>
 
 typedef struct
 {
   job_func_t func;
   void *param;
+  volatile i32 *counter; // NULL if nobody waits on it
 } job_queue_entry_t;
 
 typedef struct
@@ -47,6 +49,10 @@ u32 job_thread_func(void *param)
       if (qe.func)
       {
         qe.func(qe.param);
+        if (qe.counter)
+        {
+          sys_atomic_add(qe.counter, -1);
+        }
       }
     }
     // NOTE: this sleep makes chunk generation slower, but without it, a significant
@@ -75,14 +81,56 @@ void job_init(void)
 }
 
 void job_queue(job_func_t func, void *param)
+{
+  job_queue_counted(func, param, NULL);
+}
+
+void job_queue_counted(job_func_t func, void *param, volatile i32 *counter)
 {
   job_state_t *s = get_state();
   job_resume_all();
+  if (counter)
+  {
+    sys_atomic_add(counter, 1);
+  }
   sys_mutex_lock(s->queue_mutex);
-  s->queue[s->queue_pos++] = (job_queue_entry_t){ func, param };
+  s->queue[s->queue_pos++] = (job_queue_entry_t){ func, param, counter };
   sys_mutex_unlock(s->queue_mutex);
 }
 
+void job_wait(volatile i32 *counter)
+{
+  job_state_t *s = get_state();
+  while (*counter > 0)
+  {
+    // newest first, like the workers
+    job_queue_entry_t qe = { 0 };
+    sys_mutex_lock(s->queue_mutex);
+    for (usize i = s->queue_pos; i-- > 0;)
+    {
+      if (s->queue[i].counter == counter)
+      {
+        qe = s->queue[i];
+        memmove(&s->queue[i], &s->queue[i + 1], (s->queue_pos - i - 1) * sizeof(job_queue_entry_t));
+        s->queue_pos -= 1;
+        break;
+      }
+    }
+    sys_mutex_unlock(s->queue_mutex);
+
+    if (qe.func)
+    {
+      qe.func(qe.param);
+      sys_atomic_add(counter, -1);
+    }
+    else
+    {
+      // the rest are already running, and won't be long
+      _mm_pause();
+    }
+  }
+}
+
 void job_tick(void)
 {
 #if 0
@@ -11,6 +11,12 @@ void  job_init(void);
 void  job_queue(job_func_t func, void *param);
 void  job_tick(void);
 
+// counted jobs add one to the counter when they're queued and take it back once they've run.
+// job_wait runs the counter's jobs that no worker has picked up yet on the calling thread, then
+// waits for the ones that are running
+void  job_queue_counted(job_func_t func, void *param, volatile i32 *counter);
+void  job_wait(volatile i32 *counter);
+
 usize job_get_num_workers(void);
 isize job_get_worker_id(void);
 
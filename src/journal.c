@@ -0,0 +1,227 @@
+#include "journal.h"
+#include "game.h"
+#include "memory.h"
+#include "system.h"
+#include "constants.h"
+#include "job.h"
+#include <string.h>
+
+#define JOURNAL_MAGIC 0x4c4e524a // "JRNL"
+#define JOURNAL_VERSION 1
+
+// file layout: the header, then records back to back
+typedef struct
+{
+  u32 magic;
+  u32 version;
+} journal_header_t;
+
+typedef struct
+{
+  sys_file_t file;
+  usize num_records;
+  sys_mutex_t file_mutex; // a rewrite swaps the file out on a worker
+
+  journal_record_t buffer[JOURNAL_BUFFER_SIZE];
+  usize num_buffered;
+
+  // the rewrite in flight. records committed to the old file from rewrite_from on are carried over
+  journal_record_t *rewrite_buffer;
+  journal_record_t *rewrite_records; // the buffer, or the caller's records if they didn't fit
+  usize num_rewrite_records;
+  usize rewrite_from;
+  bool rewriting; // until the job is done with the file
+  volatile i32 rewrite_jobs;
+} journal_state_t;
+
+static journal_state_t *get_state(void)
+{
+  return game_get_state()->modules.journal;
+}
+
+static void write_header(sys_file_t file)
+{
+  journal_header_t header = { JOURNAL_MAGIC, JOURNAL_VERSION };
+  sys_file_seek(file, 0);
+  sys_file_write(file, &header, sizeof(header));
+}
+
+static void journal_open(void)
+{
+  journal_state_t *s = get_state();
+  s->file = sys_file_open(JOURNAL_FILENAME, SYS_FILE_READ | SYS_FILE_WRITE);
+  s->num_records = 0;
+  if (!s->file)
+  {
+    return;
+  }
+
+  // anything that isn't a journal gets started over
+  journal_header_t header = { 0 };
+  usize size = sys_file_get_size(s->file);
+  if (size < sizeof(header) || !sys_file_read(s->file, &header, sizeof(header)) ||
+    header.magic != JOURNAL_MAGIC || header.version > JOURNAL_VERSION)
+  {
+    write_header(s->file);
+    return;
+  }
+
+  // appending starts over a torn record at the end
+  s->num_records = (size - sizeof(header)) / sizeof(journal_record_t);
+}
+
+void journal_init(void)
+{
+  game_state_t *gs = game_get_state();
+  journal_state_t *s = gs->modules.journal = mem_hunk_push(sizeof(journal_state_t));
+  s->file_mutex = sys_mutex_new();
+  s->rewrite_buffer = mem_hunk_push(JOURNAL_MAX_REWRITE_RECORDS * sizeof(journal_record_t));
+  journal_open();
+}
+
+void journal_append(wt_vec3_t pos, block_id_t old_block, block_id_t new_block)
+{
+  journal_state_t *s = get_state();
+  WT_ASSERT(pos.x >= 0 && pos.x < JOURNAL_MAX_XZ && pos.z >= 0 && pos.z < JOURNAL_MAX_XZ &&
+    pos.y >= 0 && pos.y < CHUNK_SIZE_Y);
+
+  if (s->num_buffered == JOURNAL_BUFFER_SIZE)
+  {
+    journal_commit();
+  }
+
+  journal_record_t *r = &s->buffer[s->num_buffered++];
+  r->pos = (u32)pos.x | ((u32)pos.z << 12) | ((u32)pos.y << 24);
+  r->old_block = old_block;
+  r->new_block = new_block;
+}
+
+void journal_commit(void)
+{
+  journal_state_t *s = get_state();
+  if (s->num_buffered == 0 || !s->file)
+  {
+    s->num_buffered = 0;
+    return;
+  }
+
+  sys_mutex_lock(s->file_mutex);
+  usize offset = sizeof(journal_header_t) + s->num_records * sizeof(journal_record_t);
+  if (s->file && sys_file_seek(s->file, offset) &&
+    sys_file_write(s->file, s->buffer, s->num_buffered * sizeof(journal_record_t)))
+  {
+    s->num_records += s->num_buffered;
+  }
+  sys_mutex_unlock(s->file_mutex);
+  s->num_buffered = 0;
+}
+
+usize journal_read(journal_record_t **records)
+{
+  journal_state_t *s = get_state();
+  job_wait(&s->rewrite_jobs);
+  *records = mem_scratch_push(s->num_records * sizeof(journal_record_t));
+  if (s->num_records == 0 || !sys_file_seek(s->file, sizeof(journal_header_t)) ||
+    !sys_file_read(s->file, *records, s->num_records * sizeof(journal_record_t)))
+  {
+    return 0;
+  }
+  return s->num_records;
+}
+
+usize journal_get_num_records(void)
+{
+  journal_state_t *s = get_state();
+  sys_mutex_lock(s->file_mutex);
+  usize res = s->num_records;
+  if (s->rewriting)
+  {
+    res = s->num_rewrite_records + s->num_records - s->rewrite_from;
+  }
+  sys_mutex_unlock(s->file_mutex);
+  return res;
+}
+
+static void rewrite_job(void *param)
+{
+  WT_UNUSED(param);
+
+  journal_state_t *s = get_state();
+
+  // opening it for writing only starts it over empty
+  sys_file_t file = sys_file_open(JOURNAL_REWRITE_FILENAME, SYS_FILE_WRITE);
+  bool ok = file != NULL;
+  if (ok)
+  {
+    write_header(file);
+    ok = s->num_rewrite_records == 0 ||
+      sys_file_write(file, s->rewrite_records, s->num_rewrite_records * sizeof(journal_record_t));
+    ok = ok && sys_file_flush(file);
+  }
+
+  // commits wait from here on, but there's only what came in while the above was written left
+  sys_mutex_lock(s->file_mutex);
+  usize num_new = s->num_records - s->rewrite_from;
+  if (ok && num_new > 0)
+  {
+    mem_scratch_begin();
+    journal_record_t *records = mem_scratch_push(num_new * sizeof(journal_record_t));
+    usize offset = sizeof(journal_header_t) + s->rewrite_from * sizeof(journal_record_t);
+    ok = sys_file_seek(s->file, offset) &&
+      sys_file_read(s->file, records, num_new * sizeof(journal_record_t)) &&
+      sys_file_write(file, records, num_new * sizeof(journal_record_t)) && sys_file_flush(file);
+    mem_scratch_end();
+  }
+  if (file)
+  {
+    sys_file_close(file);
+  }
+
+  // the new journal is on the disk before it replaces the old one. if anything went wrong, the
+  // old one stays as it is
+  if (ok)
+  {
+    if (s->file)
+    {
+      sys_file_close(s->file);
+    }
+    sys_file_rename(JOURNAL_REWRITE_FILENAME, JOURNAL_FILENAME);
+    journal_open();
+  }
+  s->rewriting = false;
+  sys_mutex_unlock(s->file_mutex);
+}
+
+void journal_rewrite(journal_record_t *records, usize num_records)
+{
+  journal_state_t *s = get_state();
+  journal_commit();
+  job_wait(&s->rewrite_jobs);
+
+  s->rewriting = true;
+  s->rewrite_from = s->num_records;
+  s->num_rewrite_records = num_records;
+  s->rewrite_records = records;
+  if (num_records <= JOURNAL_MAX_REWRITE_RECORDS)
+  {
+    memcpy(s->rewrite_buffer, records, num_records * sizeof(journal_record_t));
+    s->rewrite_records = s->rewrite_buffer;
+  }
+  job_queue_counted(rewrite_job, NULL, &s->rewrite_jobs);
+
+  // the caller's records are gone once this returns
+  if (s->rewrite_records == records)
+  {
+    job_wait(&s->rewrite_jobs);
+  }
+}
+
+bool journal_is_rewriting(void)
+{
+  return get_state()->rewriting;
+}
+
+wt_vec3_t journal_record_pos(const journal_record_t *r)
+{
+  return wt_vec3(r->pos & 0xfff, r->pos >> 24, (r->pos >> 12) & 0xfff);
+}
@@ -0,0 +1,42 @@
+#ifndef JOURNAL_H
+#define JOURNAL_H
+
+#include <wt/wt.h>
+#include "block.h"
+
+// every block edit is appended to the journal as it's made, so nothing since the last save is lost
+// if the game goes down. edits are buffered and written together once a tick
+#define JOURNAL_FILENAME "test.journal"
+#define JOURNAL_REWRITE_FILENAME "test.journal.new"
+#define JOURNAL_BUFFER_SIZE 4096 // edits
+// records a rewrite can hold on to while it's written, bigger ones are waited for
+#define JOURNAL_MAX_REWRITE_RECORDS (1 << 21)
+
+// block positions in the world are packed into 12 bits for x and z, 8 for y
+#define JOURNAL_MAX_XZ (1 << 12)
+
+typedef struct
+{
+  u32 pos;
+  block_id_t old_block;
+  block_id_t new_block;
+} journal_record_t;
+
+void      journal_init(void);
+
+void      journal_append(wt_vec3_t pos, block_id_t old_block, block_id_t new_block);
+void      journal_commit(void);
+
+// every committed record, oldest first, in scratch memory. a record torn by a crash is dropped
+usize     journal_read(journal_record_t **records);
+usize     journal_get_num_records(void); // committed ones, counting a rewrite as done
+
+// replaces everything in the journal with these records. the new journal is written and flushed
+// to disk by a job, records committed in the meantime go in after them, then it's renamed over
+// the old one. until then the old one is the journal
+void      journal_rewrite(journal_record_t *records, usize num_records);
+bool      journal_is_rewriting(void);
+
+wt_vec3_t journal_record_pos(const journal_record_t *r);
+
+#endif
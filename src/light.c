@@ -0,0 +1,463 @@
+#include "light.h"
+#include "game.h"
+#include "memory.h"
+#include "world.h"
+#include "block.h"
+#include "constants.h"
+#include <string.h>
+
+// queued positions are packed into 10 bits for x and z, 8 for y and 4 for the level removed
+#define LIGHT_QUEUE_MASK (LIGHT_QUEUE_SIZE - 1)
+
+#define LIGHT_CHANNEL_SKY 0
+#define LIGHT_CHANNEL_BLOCK 1
+#define LIGHT_NUM_CHANNELS 2
+
+// down comes first, it's the only way full sky light goes without losing any
+#define LIGHT_DIR_DOWN 0
+
+static const wt_vec3_t k_dirs[] = { { 0, -1, 0 }, { 0, 1, 0 }, { -1, 0, 0 }, { 1, 0, 0 }, { 0, 0, -1 }, { 0, 0, 1 } };
+static const u32 k_shifts[LIGHT_NUM_CHANNELS] = { 4, 0 };
+
+typedef struct
+{
+  u32 items[LIGHT_QUEUE_SIZE];
+  u32 head;
+  u32 tail;
+} light_queue_t;
+
+typedef struct
+{
+  // light that's gone out has to be taken away before what's left can spread back in
+  light_queue_t add[LIGHT_NUM_CHANNELS];
+  light_queue_t remove[LIGHT_NUM_CHANNELS];
+} light_state_t;
+
+// a block in a ready chunk
+typedef struct
+{
+  chunk_t *c;
+  usize offset;
+} light_cell_t;
+
+static light_state_t *get_state(void)
+{
+  return game_get_state()->modules.light;
+}
+
+void light_init(void)
+{
+  game_state_t *gs = game_get_state();
+  gs->modules.light = mem_hunk_push(sizeof(light_state_t));
+}
+
+static u8 spread(usize channel, usize dir, u8 level, block_id_t into)
+{
+  if (channel == LIGHT_CHANNEL_SKY && dir == LIGHT_DIR_DOWN && level == LIGHT_MAX && into == 0)
+  {
+    return LIGHT_MAX;
+  }
+  return level > 0 ? level - 1 : 0;
+}
+
+static void spread_local(chunk_data_t *data, const u8 *flags, u32 *queue, u32 head, u32 tail, usize channel)
+{
+  u32 shift = k_shifts[channel];
+  while (head != tail)
+  {
+    u32 i = queue[head++ & (2 * CHUNK_NUM_BLOCKS - 1)];
+    u8 level = (data->light[i] >> shift) & 0xf;
+    i32 x = i & (CHUNK_SIZE_X - 1);
+    i32 z = (i >> CHUNK_SHIFT_X) & (CHUNK_SIZE_Z - 1);
+    i32 y = i >> (CHUNK_SHIFT_X + CHUNK_SHIFT_Z);
+
+    for (usize dir = 0; dir < WT_ARRAY_COUNT(k_dirs); ++dir)
+    {
+      i32 nx = x + k_dirs[dir].x;
+      i32 ny = y + k_dirs[dir].y;
+      i32 nz = z + k_dirs[dir].z;
+      if ((u32)nx >= CHUNK_SIZE_X || (u32)ny >= CHUNK_SIZE_Y || (u32)nz >= CHUNK_SIZE_Z)
+      {
+        continue;
+      }
+
+      u32 n = nx | (nz << CHUNK_SHIFT_X) | (ny << (CHUNK_SHIFT_X + CHUNK_SHIFT_Z));
+      block_id_t block = data->blocks[n];
+      u8 l = spread(channel, dir, level, block);
+      if ((flags[block] & BLOCK_FLAG_TRANSPARENT) && ((data->light[n] >> shift) & 0xf) < l &&
+        tail - head < 2 * CHUNK_NUM_BLOCKS)
+      {
+        data->light[n] = (data->light[n] & ~(0xf << shift)) | (l << shift);
+        queue[tail++ & (2 * CHUNK_NUM_BLOCKS - 1)] = n;
+      }
+    }
+  }
+}
+
+void light_compute_chunk(chunk_data_t *data)
+{
+  const u8 *flags = block_get_flags();
+  u8 emitted[BLOCK_MAX_COUNT];
+  for (usize i = 0; i < BLOCK_MAX_COUNT; ++i)
+  {
+    emitted[i] = block_get_info(i)->light;
+  }
+
+  mem_scratch_begin();
+  u32 *queue = mem_scratch_push(2 * CHUNK_NUM_BLOCKS * sizeof(u32));
+  memset(data->light, 0, sizeof(data->light));
+
+  // sky light falls straight down each column until it hits something
+  i32 top = 0;
+  for (usize column = 0; column < CHUNK_SIZE_X * CHUNK_SIZE_Z; ++column)
+  {
+    for (i32 y = data->heights[column]; y < CHUNK_SIZE_Y; ++y)
+    {
+      data->light[column + y * CHUNK_SIZE_X * CHUNK_SIZE_Z] = LIGHT_MAX << k_shifts[LIGHT_CHANNEL_SKY];
+    }
+    top = WT_MAX(top, data->heights[column]);
+  }
+
+  // then spreads sideways from under the highest block, above it everything is lit already
+  u32 tail = 0;
+  for (u32 i = 0; i < (u32)WT_MIN(top + 1, CHUNK_SIZE_Y) * CHUNK_SIZE_X * CHUNK_SIZE_Z; ++i)
+  {
+    if (data->light[i])
+    {
+      queue[tail++] = i;
+    }
+  }
+  spread_local(data, flags, queue, 0, tail, LIGHT_CHANNEL_SKY);
+
+  tail = 0;
+  for (u32 i = 0; i < CHUNK_NUM_BLOCKS; ++i)
+  {
+    u8 l = emitted[data->blocks[i]];
+    if (l)
+    {
+      data->light[i] |= l << k_shifts[LIGHT_CHANNEL_BLOCK];
+      queue[tail++] = i;
+    }
+  }
+  spread_local(data, flags, queue, 0, tail, LIGHT_CHANNEL_BLOCK);
+
+  mem_scratch_end();
+}
+
+static bool get_cell(i32 x, i32 y, i32 z, light_cell_t *cell)
+{
+  if ((u32)y >= CHUNK_SIZE_Y)
+  {
+    return false;
+  }
+
+  cell->c = world_get_chunk(wt_vec2(x >> CHUNK_SHIFT_X, z >> CHUNK_SHIFT_Z));
+  cell->offset = (x & (CHUNK_SIZE_X - 1)) | ((z & (CHUNK_SIZE_Z - 1)) << CHUNK_SHIFT_X) |
+    (y << (CHUNK_SHIFT_X + CHUNK_SHIFT_Z));
+  return cell->c && cell->c->status == CHUNK_STATUS_READY;
+}
+
+static void mark_chunk_dirty(wt_vec2_t chunk_pos, u32 sections)
+{
+  chunk_t *c = world_get_chunk(chunk_pos);
+  if (c)
+  {
+    c->dirty_sections |= sections;
+  }
+}
+
+static u8 get_level(light_cell_t *cell, usize channel)
+{
+  return (cell->c->data->light[cell->offset] >> k_shifts[channel]) & 0xf;
+}
+
+// the sections that read this block's light get remeshed, in its chunk and the one next to it
+static void set_level(light_cell_t *cell, i32 x, i32 y, i32 z, usize channel, u8 level)
+{
+  chunk_t *c = cell->c;
+
+  // with no version left to copy to, a mesh job might see some of the new light. the sections are
+  // marked dirty below, so it gets meshed again either way
+  chunk_unshare(c, true);
+  u8 *l = &c->data->light[cell->offset];
+  *l = (*l & ~(0xf << k_shifts[channel])) | (level << k_shifts[channel]);
+
+  wt_vec3_t pos = wt_vec3(x & (CHUNK_SIZE_X - 1), y, z & (CHUNK_SIZE_Z - 1));
+  c->dirty_sections |= chunk_sections_touched(pos);
+
+  u32 section = 1u << (y / CHUNK_SECTION_SIZE_Y);
+  if (pos.x == 0)                { mark_chunk_dirty(wt_vec2(c->position.x - 1, c->position.y), section); }
+  if (pos.x == CHUNK_SIZE_X - 1) { mark_chunk_dirty(wt_vec2(c->position.x + 1, c->position.y), section); }
+  if (pos.z == 0)                { mark_chunk_dirty(wt_vec2(c->position.x, c->position.y - 1), section); }
+  if (pos.z == CHUNK_SIZE_Z - 1) { mark_chunk_dirty(wt_vec2(c->position.x, c->position.y + 1), section); }
+}
+
+// the light a block has without any coming from its neighbors
+static u8 source_level(usize channel, i32 y, block_id_t block)
+{
+  if (channel == LIGHT_CHANNEL_BLOCK)
+  {
+    return block_get_info(block)->light;
+  }
+  return y == CHUNK_SIZE_Y - 1 && (block_get_flags()[block] & BLOCK_FLAG_TRANSPARENT) ? LIGHT_MAX : 0;
+}
+
+// full queues drop what doesn't fit, the light stays off there until something changes around it
+static void push(light_queue_t *q, i32 x, i32 y, i32 z, u8 level)
+{
+  if (q->tail - q->head < LIGHT_QUEUE_SIZE)
+  {
+    q->items[q->tail++ & LIGHT_QUEUE_MASK] = (u32)x | ((u32)z << 10) | ((u32)y << 20) | ((u32)level << 28);
+  }
+}
+
+static void pop(light_queue_t *q, i32 *x, i32 *y, i32 *z, u8 *level)
+{
+  u32 item = q->items[q->head++ & LIGHT_QUEUE_MASK];
+  *x = item & 0x3ff;
+  *z = (item >> 10) & 0x3ff;
+  *y = (item >> 20) & 0xff;
+  *level = item >> 28;
+}
+
+// runs the queues before they could fill up
+static void make_room(usize needed)
+{
+  light_state_t *s = get_state();
+  for (usize channel = 0; channel < LIGHT_NUM_CHANNELS; ++channel)
+  {
+    if (s->add[channel].tail - s->add[channel].head + needed > LIGHT_QUEUE_SIZE / 2 ||
+      s->remove[channel].tail - s->remove[channel].head + needed > LIGHT_QUEUE_SIZE / 2)
+    {
+      light_update();
+      return;
+    }
+  }
+}
+
+// whether a block keeps its light without any from the chunk c, which might have fed it before it
+// was unloaded and come back different
+static bool supported_without(chunk_t *c, light_cell_t *cell, wt_vec3_t pos, usize channel,
+  u8 level)
+{
+  block_id_t block = cell->c->data->blocks[cell->offset];
+  if (source_level(channel, pos.y, block) >= level)
+  {
+    return true;
+  }
+
+  for (usize dir = 0; dir < WT_ARRAY_COUNT(k_dirs); ++dir)
+  {
+    wt_vec3_t n = wt_vec3i_add(pos, k_dirs[dir]);
+    light_cell_t ncell;
+    if (!get_cell(n.x, n.y, n.z, &ncell) || ncell.c == c)
+    {
+      continue;
+    }
+
+    // the light comes back the other way, and the directions go in pairs
+    if (spread(channel, dir ^ 1, get_level(&ncell, channel), block) >= level)
+    {
+      return true;
+    }
+  }
+  return false;
+}
+
+void light_stitch_chunk(chunk_t *c)
+{
+  static const wt_vec2_t k_neighbors[] = { { -1, 0 }, { 1, 0 }, { 0, -1 }, { 0, 1 } };
+  light_state_t *s = get_state();
+  wt_vec3_t origin = wt_vec3(c->position.x * CHUNK_SIZE_X, 0, c->position.y * CHUNK_SIZE_Z);
+
+  // the chunk was lit as if its neighbors were dark, but they can still hold light it spread into
+  // them before it was unloaded. whatever of that nothing else holds up goes out first, then light
+  // spreads across the sides both ways
+  for (usize side = 0; side < WT_ARRAY_COUNT(k_neighbors); ++side)
+  {
+    chunk_t *n = world_get_chunk(wt_vec2i_add(c->position, k_neighbors[side]));
+    if (!n || n->status != CHUNK_STATUS_READY)
+    {
+      continue;
+    }
+
+    make_room(2 * CHUNK_SIZE_X * CHUNK_SIZE_Y);
+    for (i32 y = 0; y < CHUNK_SIZE_Y; ++y)
+    {
+      for (i32 i = 0; i < CHUNK_SIZE_X; ++i)
+      {
+        wt_vec3_t a = origin;
+        a.y = y;
+        if (k_neighbors[side].x)
+        {
+          a.x += k_neighbors[side].x < 0 ? 0 : CHUNK_SIZE_X - 1;
+          a.z += i;
+        }
+        else
+        {
+          a.x += i;
+          a.z += k_neighbors[side].y < 0 ? 0 : CHUNK_SIZE_Z - 1;
+        }
+        wt_vec3_t b = wt_vec3(a.x + k_neighbors[side].x, y, a.z + k_neighbors[side].y);
+
+        light_cell_t ca, cb;
+        get_cell(a.x, a.y, a.z, &ca);
+        get_cell(b.x, b.y, b.z, &cb);
+        for (usize channel = 0; channel < LIGHT_NUM_CHANNELS; ++channel)
+        {
+          u8 la = get_level(&ca, channel);
+          u8 lb = get_level(&cb, channel);
+          if (lb > 0 && !supported_without(c, &cb, b, channel, lb))
+          {
+            set_level(&cb, b.x, b.y, b.z, channel, 0);
+            push(&s->remove[channel], b.x, b.y, b.z, lb);
+            lb = 0;
+          }
+
+          if (la > lb + 1)
+          {
+            push(&s->add[channel], a.x, a.y, a.z, 0);
+          }
+          else if (lb > la + 1)
+          {
+            push(&s->add[channel], b.x, b.y, b.z, 0);
+          }
+        }
+      }
+    }
+  }
+}
+
+void light_block_changed(wt_vec3_t pos)
+{
+  light_state_t *s = get_state();
+  light_cell_t cell;
+  if (!get_cell(pos.x, pos.y, pos.z, &cell))
+  {
+    return;
+  }
+  make_room(WT_ARRAY_COUNT(k_dirs) + 1);
+
+  // whatever the block lit goes out, then the light around it and its own spread back in
+  block_id_t block = cell.c->data->blocks[cell.offset];
+  bool transparent = block_get_flags()[block] & BLOCK_FLAG_TRANSPARENT;
+  for (usize channel = 0; channel < LIGHT_NUM_CHANNELS; ++channel)
+  {
+    u8 level = get_level(&cell, channel);
+    u8 source = source_level(channel, pos.y, block);
+    if (level > 0)
+    {
+      set_level(&cell, pos.x, pos.y, pos.z, channel, 0);
+      push(&s->remove[channel], pos.x, pos.y, pos.z, level);
+    }
+    if (source > 0)
+    {
+      set_level(&cell, pos.x, pos.y, pos.z, channel, source);
+      push(&s->add[channel], pos.x, pos.y, pos.z, 0);
+    }
+
+    for (usize dir = 0; dir < WT_ARRAY_COUNT(k_dirs) && transparent; ++dir)
+    {
+      wt_vec3_t n = wt_vec3i_add(pos, k_dirs[dir]);
+      light_cell_t ncell;
+      if (get_cell(n.x, n.y, n.z, &ncell) && get_level(&ncell, channel) > 0)
+      {
+        push(&s->add[channel], n.x, n.y, n.z, 0);
+      }
+    }
+  }
+}
+
+static void remove_light(usize channel)
+{
+  light_state_t *s = get_state();
+  light_queue_t *q = &s->remove[channel];
+  while (q->head != q->tail)
+  {
+    i32 x, y, z;
+    u8 level;
+    pop(q, &x, &y, &z, &level);
+
+    for (usize dir = 0; dir < WT_ARRAY_COUNT(k_dirs); ++dir)
+    {
+      i32 nx = x + k_dirs[dir].x;
+      i32 ny = y + k_dirs[dir].y;
+      i32 nz = z + k_dirs[dir].z;
+      light_cell_t n;
+      if (!get_cell(nx, ny, nz, &n))
+      {
+        continue;
+      }
+
+      // anything dimmer (or fed straight down by full sky light) got its light from here.
+      // anything at least as bright is lit some other way, and lights the gap back up
+      u8 l = get_level(&n, channel);
+      bool fed = l < level || (channel == LIGHT_CHANNEL_SKY && dir == LIGHT_DIR_DOWN && level == LIGHT_MAX);
+      if (l > 0 && fed)
+      {
+        set_level(&n, nx, ny, nz, channel, 0);
+        push(q, nx, ny, nz, l);
+
+        u8 source = source_level(channel, ny, n.c->data->blocks[n.offset]);
+        if (source > 0)
+        {
+          set_level(&n, nx, ny, nz, channel, source);
+          push(&s->add[channel], nx, ny, nz, 0);
+        }
+      }
+      else if (l > 0)
+      {
+        push(&s->add[channel], nx, ny, nz, 0);
+      }
+    }
+  }
+}
+
+static void add_light(usize channel)
+{
+  light_state_t *s = get_state();
+  light_queue_t *q = &s->add[channel];
+  while (q->head != q->tail)
+  {
+    i32 x, y, z;
+    u8 unused;
+    pop(q, &x, &y, &z, &unused);
+
+    light_cell_t cell;
+    if (!get_cell(x, y, z, &cell))
+    {
+      continue;
+    }
+    u8 level = get_level(&cell, channel);
+    const u8 *flags = block_get_flags();
+
+    for (usize dir = 0; dir < WT_ARRAY_COUNT(k_dirs) && level > 1; ++dir)
+    {
+      i32 nx = x + k_dirs[dir].x;
+      i32 ny = y + k_dirs[dir].y;
+      i32 nz = z + k_dirs[dir].z;
+      light_cell_t n;
+      if (!get_cell(nx, ny, nz, &n))
+      {
+        continue;
+      }
+
+      block_id_t block = n.c->data->blocks[n.offset];
+      u8 l = spread(channel, dir, level, block);
+      if ((flags[block] & BLOCK_FLAG_TRANSPARENT) && get_level(&n, channel) < l)
+      {
+        set_level(&n, nx, ny, nz, channel, l);
+        push(q, nx, ny, nz, 0);
+      }
+    }
+  }
+}
+
+void light_update(void)
+{
+  for (usize channel = 0; channel < LIGHT_NUM_CHANNELS; ++channel)
+  {
+    remove_light(channel);
+    add_light(channel);
+  }
+}
@@ -0,0 +1,31 @@
+#ifndef LIGHT_H
+#define LIGHT_H
+
+#include <wt/wt.h>
+#include "chunk.h"
+
+// every block has a byte of light: sky light in the high nibble, light from blocks that give it off
+// in the low one. light spreads through blocks that aren't solid, losing a level per block, except
+// for full sky light going straight down through air
+#define LIGHT_MAX 15
+#define LIGHT_SKY(l) ((l) >> 4)
+#define LIGHT_BLOCK(l) ((l) & 0xf)
+
+// the queues edits feed light_update with, in changed blocks
+#define LIGHT_QUEUE_SIZE (1 << 20)
+
+void light_init(void);
+
+// lights a chunk's blocks as if nothing around it gave off any light, its heights need to be up to
+// date. safe to call from jobs, as long as nothing else writes the data
+void light_compute_chunk(chunk_data_t *data);
+
+// lets light across the sides of a chunk that just got ready and its ready neighbors
+void light_stitch_chunk(chunk_t *c);
+
+// queues up the light around a block that changed, light_update spreads it. both only go through
+// ready chunks, and mark the sections whose light changes dirty
+void light_block_changed(wt_vec3_t pos);
+void light_update(void);
+
+#endif
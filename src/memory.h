@@ -4,7 +4,8 @@
 #include <wt/wt.h>
 
 #define MEM_SCRATCH_DEPTH 256
-#define MEM_WORKER_ARENA_SIZE WT_MEGABYTES(16)
+// meshing takes up most of it with worst case buffers, the rest is for the mesh cache
+#define MEM_WORKER_ARENA_SIZE WT_MEGABYTES(32)
 
 void mem_init(void);
 void mem_post_init(void); // this is seperate because we must wait for the system module to initialize
@@ -0,0 +1,300 @@
+#include "meshcache.h"
+#include "game.h"
+#include "memory.h"
+#include "system.h"
+#include "constants.h"
+#include "chunk.h"
+#include <string.h>
+#include <zstd.h>
+
+#define MESHCACHE_MAGIC 0x4348534d // "MSHC"
+#define MESHCACHE_VERSION 4 // bump whenever the mesher changes what it puts out, or what keys are hashed from
+#define MESHCACHE_ZSTD_LEVEL 1
+
+// twice the entries, so probes stay short
+#define MESHCACHE_NUM_SLOTS (MESHCACHE_MAX_ENTRIES * 2)
+
+// file layout: the header, then entries back to back, each followed by its payload.
+// the payload is the vertices and then the indices, compressed together with zstd
+typedef struct
+{
+  u32 magic;
+  u32 version;
+  wt_hash_u128_t blocks_hash; // of every block's tiles and solidity, see hash_blocks
+} meshcache_header_t;
+
+typedef struct
+{
+  wt_hash_u128_t key;
+  u32 size;
+  u32 num_vertices;
+  u32 num_indices;
+  u32 reserved;
+} meshcache_entry_t;
+
+typedef struct
+{
+  wt_hash_u128_t key;
+  u64 offset; // of the payload, 0 for an empty slot
+  u32 size;
+  u32 num_vertices;
+  u32 num_indices;
+} meshcache_slot_t;
+
+typedef struct
+{
+  sys_file_t file;
+  sys_mutex_t mutex;
+  wt_hash_u128_t blocks_hash;
+  usize end; // where the next entry goes
+
+  meshcache_slot_t slots[MESHCACHE_NUM_SLOTS];
+  usize num_entries;
+} meshcache_state_t;
+
+static meshcache_state_t *get_state(void)
+{
+  return game_get_state()->modules.meshcache;
+}
+
+// only what the mesher looks at, so renaming a block doesn't throw the cache away
+static wt_hash_u128_t hash_blocks(void)
+{
+  typedef struct { wt_vec2_t atlas_tiles[6]; u32 solid; } hashed_block_t;
+
+  mem_scratch_begin();
+  hashed_block_t *blocks = mem_scratch_push(BLOCK_MAX_COUNT * sizeof(hashed_block_t));
+  for (usize i = 0; i < BLOCK_MAX_COUNT; ++i)
+  {
+    block_info_t *info = block_get_info(i);
+    memcpy(blocks[i].atlas_tiles, info->atlas_tiles, sizeof(info->atlas_tiles));
+    blocks[i].solid = info->solid;
+  }
+  wt_hash_u128_t res = wt_hash_u128(blocks, BLOCK_MAX_COUNT * sizeof(hashed_block_t));
+  mem_scratch_end();
+  return res;
+}
+
+static bool same_key(wt_hash_u128_t a, wt_hash_u128_t b)
+{
+  return a.low == b.low && a.high == b.high;
+}
+
+// the slot holding the key, or the empty one it would go in
+static meshcache_slot_t *find_slot(wt_hash_u128_t key)
+{
+  meshcache_state_t *s = get_state();
+  usize i = key.low & (MESHCACHE_NUM_SLOTS - 1);
+  while (s->slots[i].offset && !same_key(s->slots[i].key, key))
+  {
+    i = (i + 1) & (MESHCACHE_NUM_SLOTS - 1);
+  }
+  return &s->slots[i];
+}
+
+static void start_over(void)
+{
+  meshcache_state_t *s = get_state();
+  memset(s->slots, 0, sizeof(s->slots));
+  s->num_entries = 0;
+  s->end = sizeof(meshcache_header_t);
+
+  // opening it for writing only starts it over empty
+  if (s->file)
+  {
+    sys_file_close(s->file);
+  }
+  sys_file_t file = sys_file_open(MESHCACHE_FILENAME, SYS_FILE_WRITE);
+  if (file)
+  {
+    meshcache_header_t header = { MESHCACHE_MAGIC, MESHCACHE_VERSION, s->blocks_hash };
+    sys_file_write(file, &header, sizeof(header));
+    sys_file_close(file);
+  }
+  s->file = sys_file_open(MESHCACHE_FILENAME, SYS_FILE_READ | SYS_FILE_WRITE);
+}
+
+// indexes every entry in the file, anything after one torn by a crash gets written over
+static bool read_entries(void)
+{
+  meshcache_state_t *s = get_state();
+  sys_file_mapping_t map = sys_file_map(s->file);
+  if (!map.data)
+  {
+    return false;
+  }
+
+  meshcache_header_t header = { 0 };
+  bool res = map.size >= sizeof(header);
+  if (res)
+  {
+    memcpy(&header, map.data, sizeof(header));
+    res = header.magic == MESHCACHE_MAGIC && header.version == MESHCACHE_VERSION &&
+      same_key(header.blocks_hash, s->blocks_hash);
+  }
+
+  usize pos = sizeof(header);
+  while (res && pos + sizeof(meshcache_entry_t) <= map.size && s->num_entries < MESHCACHE_MAX_ENTRIES)
+  {
+    meshcache_entry_t entry = { 0 };
+    memcpy(&entry, map.data + pos, sizeof(entry));
+    usize offset = pos + sizeof(entry);
+    if (offset + entry.size > map.size)
+    {
+      break;
+    }
+
+    // meshcache_find pushes room for this many, a corrupt entry could ask for any amount. the
+    // entries after it can't be trusted either
+    if (entry.num_vertices > REN_CHUNK_MAX_VERTICES || entry.num_indices > REN_CHUNK_MAX_INDICES)
+    {
+      break;
+    }
+
+    meshcache_slot_t *slot = find_slot(entry.key);
+    if (!slot->offset)
+    {
+      slot->key = entry.key;
+      slot->offset = offset;
+      slot->size = entry.size;
+      slot->num_vertices = entry.num_vertices;
+      slot->num_indices = entry.num_indices;
+      ++s->num_entries;
+    }
+    pos = offset + entry.size;
+  }
+  s->end = pos;
+
+  sys_file_unmap(&map);
+  return res;
+}
+
+void meshcache_init(void)
+{
+  game_state_t *gs = game_get_state();
+  meshcache_state_t *s = gs->modules.meshcache = mem_hunk_push(sizeof(meshcache_state_t));
+  s->mutex = sys_mutex_new();
+  s->blocks_hash = hash_blocks();
+
+  // a cache made for other blocks or by another mesher is no use
+  s->file = sys_file_open(MESHCACHE_FILENAME, SYS_FILE_READ | SYS_FILE_WRITE);
+  if (!s->file || !read_entries())
+  {
+    start_over();
+  }
+}
+
+wt_hash_u128_t meshcache_key(block_id_t *padded, u8 *padded_light, usize section)
+{
+  // the section and the layers right above and below it
+  usize y = section * CHUNK_SECTION_SIZE_Y;
+  usize first = CHUNK_PADDED_INDEX(-1, (i32)y - 1, -1);
+  usize num_blocks = (CHUNK_SECTION_SIZE_Y + 2) * CHUNK_PADDED_SIZE_X * CHUNK_PADDED_SIZE_Z;
+  wt_hash_u128_t res = wt_hash_u128(padded + first, num_blocks * sizeof(block_id_t));
+
+  // the same blocks lit differently or at another height make another mesh
+  wt_hash_u128_t light_hash = wt_hash_u128(padded_light + first, num_blocks);
+  res.low ^= (light_hash.low + section) * 0x9e3779b97f4a7c15ull;
+  res.high ^= light_hash.high * 0xc2b2ae3d27d4eb4full;
+  return res;
+}
+
+bool meshcache_find(wt_hash_u128_t key, ren_chunk_mesh_t *mesh)
+{
+  meshcache_state_t *s = get_state();
+  if (!s->file)
+  {
+    return false;
+  }
+
+  sys_mutex_lock(s->mutex);
+  meshcache_slot_t slot = *find_slot(key);
+  void *data = NULL;
+  if (slot.offset)
+  {
+    data = mem_scratch_push(slot.size);
+    if (!sys_file_seek(s->file, slot.offset) || !sys_file_read(s->file, data, slot.size))
+    {
+      data = NULL;
+    }
+  }
+  sys_mutex_unlock(s->mutex);
+
+  if (!data)
+  {
+    return false;
+  }
+
+  usize num_bytes = (slot.num_vertices + slot.num_indices) * sizeof(u32);
+  u32 *vertices = mem_scratch_push(num_bytes);
+  if (ZSTD_decompress(vertices, num_bytes, data, slot.size) != num_bytes)
+  {
+    return false;
+  }
+
+  mesh->vertices = vertices;
+  mesh->indices = vertices + slot.num_vertices;
+  mesh->num_vertices = slot.num_vertices;
+  mesh->num_indices = slot.num_indices;
+  return true;
+}
+
+void meshcache_store(wt_hash_u128_t key, ren_chunk_mesh_t *mesh)
+{
+  meshcache_state_t *s = get_state();
+  if (!s->file)
+  {
+    return;
+  }
+
+  mem_scratch_begin();
+  usize vertices_num_bytes = mesh->num_vertices * sizeof(u32);
+  usize indices_num_bytes = mesh->num_indices * sizeof(u32);
+  byte_t *src = mem_scratch_push(vertices_num_bytes + indices_num_bytes);
+  memcpy(src, mesh->vertices, vertices_num_bytes);
+  memcpy(src + vertices_num_bytes, mesh->indices, indices_num_bytes);
+
+  usize bound = ZSTD_compressBound(vertices_num_bytes + indices_num_bytes);
+  byte_t *buf = mem_scratch_push(sizeof(meshcache_entry_t) + bound);
+  usize size = ZSTD_compress(buf + sizeof(meshcache_entry_t), bound, src,
+    vertices_num_bytes + indices_num_bytes, MESHCACHE_ZSTD_LEVEL);
+  if (ZSTD_isError(size))
+  {
+    mem_scratch_end();
+    return;
+  }
+
+  meshcache_entry_t entry = { 0 };
+  entry.key = key;
+  entry.size = size;
+  entry.num_vertices = mesh->num_vertices;
+  entry.num_indices = mesh->num_indices;
+  memcpy(buf, &entry, sizeof(entry));
+  usize total = sizeof(entry) + size;
+
+  sys_mutex_lock(s->mutex);
+
+  // another worker may have meshed the same blocks in the meantime
+  if (!find_slot(key)->offset)
+  {
+    if (s->num_entries == MESHCACHE_MAX_ENTRIES || s->end + total > MESHCACHE_MAX_FILE_SIZE)
+    {
+      start_over();
+    }
+
+    if (s->file && sys_file_seek(s->file, s->end) && sys_file_write(s->file, buf, total))
+    {
+      meshcache_slot_t *slot = find_slot(key);
+      slot->key = key;
+      slot->offset = s->end + sizeof(entry);
+      slot->size = size;
+      slot->num_vertices = entry.num_vertices;
+      slot->num_indices = entry.num_indices;
+      ++s->num_entries;
+      s->end += total;
+    }
+  }
+
+  sys_mutex_unlock(s->mutex);
+  mem_scratch_end();
+}
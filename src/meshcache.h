@@ -0,0 +1,26 @@
+#ifndef MESHCACHE_H
+#define MESHCACHE_H
+
+#include <wt/wt.h>
+#include "renderer.h"
+
+// chunk section meshes are kept on disk next to the world, keyed by a hash of everything that goes
+// into them: the section's blocks padded with the blocks just outside it, and their light. a chunk that hasn't changed since it
+// was last meshed (on this run or any before) gets its mesh read back instead of rebuilt
+#define MESHCACHE_FILENAME "test.meshcache"
+#define MESHCACHE_MAX_ENTRIES 65536
+
+// once either runs out the cache starts over, which also gets rid of meshes of old edits
+#define MESHCACHE_MAX_FILE_SIZE WT_MEGABYTES(512)
+
+// has to be called once every block exists, the cache only holds for the blocks it was made with
+void           meshcache_init(void);
+
+// of a section of a padded volume, see ren_chunk_build_mesh
+wt_hash_u128_t meshcache_key(block_id_t *padded, u8 *padded_light, usize section);
+
+// safe to call from any thread. found meshes are read into scratch memory
+bool           meshcache_find(wt_hash_u128_t key, ren_chunk_mesh_t *mesh);
+void           meshcache_store(wt_hash_u128_t key, ren_chunk_mesh_t *mesh);
+
+#endif
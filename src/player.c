@@ -36,13 +36,19 @@ static player_state_t *get_state(void)
   return game_get_state()->modules.player;
 }
 
+// on the ground if the spawn chunk is loaded, otherwise high up until it is
+static wt_vec3f_t spawn_position(void)
+{
+  wt_vec2_t spawn = world_get_spawn_chunk();
+  i32 ground = world_get_solid_height(spawn.x * CHUNK_SIZE_X, spawn.y * CHUNK_SIZE_Z);
+  return wt_vec3f(spawn.x * CHUNK_SIZE_X, ground > 0 ? ground : 511.0f, spawn.y * CHUNK_SIZE_Z);
+}
+
 void player_init(void)
 {
   game_state_t *gs = game_get_state();
   player_state_t *s = gs->modules.player = mem_hunk_push(sizeof(player_state_t));
-
-  s->position = wt_vec3f((WORLD_MAX_CHUNKS_X - 1) * CHUNK_SIZE_X, 511.0f,
-    (WORLD_MAX_CHUNKS_Z - 1) * CHUNK_SIZE_Z);
+  s->position = spawn_position();
 }
 
 // todo: this function and the next are extremely similar.
@@ -53,6 +59,7 @@ static bool player_collides_with_world(void)
 
   // worst case scenario is 12 blocks for a ~1x2x1 bounding box
   wt_vec3_t blocks[12] = { 0 };
+  block_id_t ids[12] = { 0 };
   usize num_blocks = 0;
 
   // determine which blocks the player is intersecting
@@ -67,9 +74,12 @@ static bool player_collides_with_world(void)
   {
     for (i64 z = minz; z < maxz; ++z)
     {
+      world_cursor_t cur = world_cursor(wt_vec3(minx, y, z));
       for (i64 x = minx; x < maxx; ++x)
       {
+        ids[num_blocks] = world_cursor_get(&cur);
         blocks[num_blocks++] = wt_vec3(x, y, z);
+        world_cursor_step_x(&cur, 1);
       }
     }
   }
@@ -81,26 +91,23 @@ static bool player_collides_with_world(void)
 
   for (usize i = 0; i < num_blocks; ++i)
   {
-    if (world_within_bounds(blocks[i]))
+    // blocks outside the world read as air, fluids and the like can be walked through
+    if (block_get_flags()[ids[i]] & BLOCK_FLAG_SOLID)
     {
-      block_id_t id = world_get_block(blocks[i]);
-      if (id != 0)
+      // todo: get mesh from block info
+      const wt_vec3f_t block_size = wt_vec3f(1, 1, 1);
+      wt_vec3f_t block_pos = wt_vec3i_to_vec3f(blocks[i]);
+
+      bool collision =
+        player_pos.x <= block_pos.x + block_size.x &&
+        player_pos.x + player_size.x >= block_pos.x &&
+        player_pos.y <= block_pos.y + block_size.y &&
+        player_pos.y + player_size.y >= block_pos.y &&
+        player_pos.z <= block_pos.z + block_size.z &&
+        player_pos.z + player_size.z >= block_pos.z;
+      if (collision)
       {
-        // todo: get mesh from block info
-        const wt_vec3f_t block_size = wt_vec3f(1, 1, 1);
-        wt_vec3f_t block_pos = wt_vec3i_to_vec3f(blocks[i]);
-
-        bool collision =
-          player_pos.x <= block_pos.x + block_size.x &&
-          player_pos.x + player_size.x >= block_pos.x &&
-          player_pos.y <= block_pos.y + block_size.y &&
-          player_pos.y + player_size.y >= block_pos.y &&
-          player_pos.z <= block_pos.z + block_size.z &&
-          player_pos.z + player_size.z >= block_pos.z;
-        if (collision)
-        {
-          return true;
-        }
+        return true;
       }
     }
   }
@@ -397,8 +404,8 @@ void player_tick(void)
 
   if (sys_key_pressed(SYS_KEYCODE_P))
   {
-    s->position = wt_vec3f((WORLD_MAX_CHUNKS_X - 1) * CHUNK_SIZE_X, 511.0f,
-      (WORLD_MAX_CHUNKS_Z - 1) * CHUNK_SIZE_Z);
+    s->position = spawn_position();
+    s->velocity.y = 0;
   }
 }
 
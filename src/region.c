@@ -0,0 +1,516 @@
+#include "region.h"
+#include "game.h"
+#include "memory.h"
+#include "system.h"
+#include "constants.h"
+#include <stdio.h>
+#include <string.h>
+#include <zstd.h>
+
+#define REGION_MAGIC 0x4e474552 // "REGN"
+#define REGION_VERSION 4 // 2: added dict_id, 3: added codec to entries, 4: entries can share a payload
+
+// a chunk can never compress worse than this
+#define REGION_CHUNK_MAX_SECTORS \
+  ((ZSTD_COMPRESSBOUND(CHUNK_NUM_BLOCKS * sizeof(block_id_t)) + REGION_SECTOR_SIZE - 1) / REGION_SECTOR_SIZE)
+
+#define REGION_HEADER_SECTORS ((sizeof(region_header_t) + REGION_SECTOR_SIZE - 1) / REGION_SECTOR_SIZE)
+#define REGION_MAX_SECTORS (REGION_HEADER_SECTORS + REGION_NUM_CHUNKS * REGION_CHUNK_MAX_SECTORS)
+
+// file layout:
+//   header, padded out to a whole number of sectors
+//   chunk payloads, each starting on a sector boundary
+// a sector offset of 0 means the chunk isn't stored in this region. chunks that compress to the
+// same payload (all air, flat ground, copies of a structure) point at a single copy of it
+// older versions had a full u32 size, which never got anywhere near 24 bits,
+// so their codec reads as 0 (zstd)
+typedef struct
+{
+  u32 sector;
+  u32 size_and_codec; // the size in the low REGION_ENTRY_SIZE_BITS bits, the codec_id_t above it
+} region_entry_t;
+
+#define REGION_ENTRY_SIZE_BITS 24
+#define REGION_ENTRY_SIZE_MASK ((1u << REGION_ENTRY_SIZE_BITS) - 1)
+
+typedef struct
+{
+  u32 magic;
+  u32 version;
+  u32 sector_size;
+  u32 region_size;
+  region_entry_t entries[REGION_NUM_CHUNKS];
+
+  // dictionary the chunks were compressed with back when there was one, always 0 now. comes after
+  // the entries so version 1 files read it as 0
+  u32 dict_id;
+} region_header_t;
+
+typedef struct
+{
+  wt_vec2_t pos;
+  sys_file_t file;
+  u64 last_used_tick;
+
+  // chunks are read straight out of the mapping. while anything is pinned, the mapping can't be
+  // replaced or closed
+  sys_file_mapping_t map;
+  i32 num_pins;
+
+  region_header_t header;
+  u64 used_sectors[(REGION_MAX_SECTORS + 63) / 64];
+
+  // payload hash of every stored chunk, worked out when the region is opened
+  wt_hash_u128_t hashes[REGION_NUM_CHUNKS];
+} region_t;
+
+typedef struct
+{
+  region_t regions[REGION_MAX_OPEN];
+  u64 tick;
+} region_state_t;
+
+static region_state_t *get_state(void)
+{
+  return game_get_state()->modules.region;
+}
+
+void region_init(void)
+{
+  game_state_t *gs = game_get_state();
+  gs->modules.region = mem_hunk_push(sizeof(region_state_t));
+}
+
+static void region_close(region_t *r)
+{
+  WT_ASSERT(r->num_pins == 0);
+  sys_file_unmap(&r->map);
+  sys_file_close(r->file);
+  r->file = NULL;
+}
+
+void region_close_all(void)
+{
+  region_state_t *s = get_state();
+  for (usize i = 0; i < REGION_MAX_OPEN; ++i)
+  {
+    if (s->regions[i].file)
+    {
+      region_close(&s->regions[i]);
+    }
+  }
+}
+
+static wt_vec2_t region_pos_from_chunk(wt_vec2_t chunk_pos)
+{
+  return wt_vec2(chunk_pos.x / REGION_SIZE, chunk_pos.y / REGION_SIZE);
+}
+
+static usize region_index_from_chunk(wt_vec2_t chunk_pos)
+{
+  return (chunk_pos.x % REGION_SIZE) + (chunk_pos.y % REGION_SIZE) * REGION_SIZE;
+}
+
+static usize entry_size(const region_entry_t *e)
+{
+  return e->size_and_codec & REGION_ENTRY_SIZE_MASK;
+}
+
+static codec_id_t entry_codec(const region_entry_t *e)
+{
+  return (codec_id_t)(e->size_and_codec >> REGION_ENTRY_SIZE_BITS);
+}
+
+static void entry_set(region_entry_t *e, u32 sector, usize size, codec_id_t codec)
+{
+  e->sector = sector;
+  e->size_and_codec = ((u32)size & REGION_ENTRY_SIZE_MASK) |
+    ((u32)codec << REGION_ENTRY_SIZE_BITS);
+}
+
+static u32 sectors_for_size(usize size)
+{
+  return (size + REGION_SECTOR_SIZE - 1) / REGION_SECTOR_SIZE;
+}
+
+static void mark_sectors(region_t *r, u32 first, u32 count, bool used)
+{
+  for (u32 i = first; i < first + count && i < REGION_MAX_SECTORS; ++i)
+  {
+    if (used) { r->used_sectors[i / 64] |=  (1ull << (i % 64)); }
+    else      { r->used_sectors[i / 64] &= ~(1ull << (i % 64)); }
+  }
+}
+
+static bool sector_used(region_t *r, u32 sector)
+{
+  return (r->used_sectors[sector / 64] >> (sector % 64)) & 1;
+}
+
+// first fit, returns 0 if there's no room
+static u32 find_free_sectors(region_t *r, u32 count)
+{
+  u32 run_start = REGION_HEADER_SECTORS;
+  u32 run_length = 0;
+  for (u32 i = REGION_HEADER_SECTORS; i < REGION_MAX_SECTORS; ++i)
+  {
+    if (sector_used(r, i))
+    {
+      run_start = i + 1;
+      run_length = 0;
+    }
+    else if (++run_length == count)
+    {
+      return run_start;
+    }
+  }
+  return 0;
+}
+
+static void region_filename(wt_vec2_t region_pos, char *buf, usize buf_size)
+{
+  snprintf(buf, buf_size, REGION_FILENAME_FORMAT, region_pos.x, region_pos.y);
+}
+
+static bool region_open(region_t *r, wt_vec2_t region_pos, bool create)
+{
+  char filename[256];
+  region_filename(region_pos, filename, sizeof(filename));
+
+  if (!create)
+  {
+    sys_file_t probe = sys_file_open(filename, SYS_FILE_READ);
+    if (!probe)
+    {
+      return false;
+    }
+    sys_file_close(probe);
+  }
+
+  sys_file_t file = sys_file_open(filename, SYS_FILE_READ | SYS_FILE_WRITE);
+  if (!file)
+  {
+    return false;
+  }
+
+  memset(r, 0, sizeof(*r));
+  r->pos = region_pos;
+  r->file = file;
+
+  r->map = sys_file_map(file);
+  if (r->map.size >= sizeof(region_header_t))
+  {
+    memcpy(&r->header, r->map.data, sizeof(r->header));
+  }
+
+  // a region that can't be read starts over empty, like a brand new one. its chunks get generated
+  // again as they're streamed in, and whatever is saved next overwrites it
+  if (r->header.magic != REGION_MAGIC || r->header.version > REGION_VERSION ||
+    r->header.sector_size != REGION_SECTOR_SIZE || r->header.region_size != REGION_SIZE)
+  {
+    if (r->map.size >= sizeof(region_header_t))
+    {
+      game_dbg_print("%s can't be read, its chunks will be generated again", filename);
+    }
+    memset(&r->header, 0, sizeof(r->header));
+    r->header.magic = REGION_MAGIC;
+    r->header.version = REGION_VERSION;
+    r->header.sector_size = REGION_SECTOR_SIZE;
+    r->header.region_size = REGION_SIZE;
+    sys_file_seek(file, 0);
+    sys_file_write(file, &r->header, sizeof(r->header));
+  }
+
+  // chunks compressed against the old dictionary fail to decompress and get generated again (see
+  // world.c), each zstd frame records whether it used one
+
+  mark_sectors(r, 0, REGION_HEADER_SECTORS, true);
+  for (usize i = 0; i < REGION_NUM_CHUNKS; ++i)
+  {
+    region_entry_t *e = &r->header.entries[i];
+    usize offset = (usize)e->sector * REGION_SECTOR_SIZE;
+    if (e->sector != 0)
+    {
+      mark_sectors(r, e->sector, sectors_for_size(entry_size(e)), true);
+      if (offset + entry_size(e) <= r->map.size)
+      {
+        r->hashes[i] = wt_hash_u128(r->map.data + offset, entry_size(e));
+      }
+    }
+  }
+  return true;
+}
+
+static region_t *get_region(wt_vec2_t chunk_pos, bool create)
+{
+  region_state_t *s = get_state();
+  wt_vec2_t region_pos = region_pos_from_chunk(chunk_pos);
+  s->tick += 1;
+
+  region_t *slot = NULL;
+  for (usize i = 0; i < REGION_MAX_OPEN; ++i)
+  {
+    region_t *r = &s->regions[i];
+    if (r->file && r->pos.x == region_pos.x && r->pos.y == region_pos.y)
+    {
+      r->last_used_tick = s->tick;
+      return r;
+    }
+
+    // prefer a closed slot, otherwise close whichever unpinned region was used least recently
+    if (r->num_pins == 0 &&
+      (!slot || (slot->file && (!r->file || r->last_used_tick < slot->last_used_tick))))
+    {
+      slot = r;
+    }
+  }
+
+  if (!slot)
+  {
+    WT_ASSERT(false && "every open region is pinned");
+    return NULL;
+  }
+
+  if (slot->file)
+  {
+    region_close(slot);
+  }
+
+  if (region_open(slot, region_pos, create))
+  {
+    slot->last_used_tick = s->tick;
+    return slot;
+  }
+  return NULL;
+}
+
+bool region_exists(wt_vec2_t chunk_pos)
+{
+  return get_region(chunk_pos, false) != NULL;
+}
+
+bool region_has_chunk(wt_vec2_t chunk_pos)
+{
+  region_t *r = get_region(chunk_pos, false);
+  return r && r->header.entries[region_index_from_chunk(chunk_pos)].sector != 0;
+}
+
+bool region_read_chunk(wt_vec2_t chunk_pos, void **data, usize *size, codec_id_t *codec)
+{
+  region_t *r = get_region(chunk_pos, false);
+  if (!r)
+  {
+    return false;
+  }
+
+  region_entry_t *e = &r->header.entries[region_index_from_chunk(chunk_pos)];
+  if (e->sector == 0)
+  {
+    return false;
+  }
+
+  void *buf = mem_scratch_push(entry_size(e));
+  if (sys_file_seek(r->file, (usize)e->sector * REGION_SECTOR_SIZE) &&
+    sys_file_read(r->file, buf, entry_size(e)))
+  {
+    *data = buf;
+    *size = entry_size(e);
+    *codec = entry_codec(e);
+    return true;
+  }
+  return false;
+}
+
+bool region_map_chunk(wt_vec2_t chunk_pos, const void **data, usize *size, codec_id_t *codec)
+{
+  region_t *r = get_region(chunk_pos, false);
+  if (!r)
+  {
+    return false;
+  }
+
+  region_entry_t *e = &r->header.entries[region_index_from_chunk(chunk_pos)];
+  usize end = (usize)e->sector * REGION_SECTOR_SIZE + entry_size(e);
+  if (e->sector == 0)
+  {
+    return false;
+  }
+
+  // the file has grown since it was mapped
+  if (end > r->map.size && r->num_pins == 0)
+  {
+    sys_file_unmap(&r->map);
+    r->map = sys_file_map(r->file);
+  }
+  if (end > r->map.size)
+  {
+    return false;
+  }
+
+  r->num_pins += 1;
+  *data = r->map.data + (usize)e->sector * REGION_SECTOR_SIZE;
+  *size = entry_size(e);
+  *codec = entry_codec(e);
+  return true;
+}
+
+void region_unpin_chunk(wt_vec2_t chunk_pos)
+{
+  region_state_t *s = get_state();
+  wt_vec2_t region_pos = region_pos_from_chunk(chunk_pos);
+  for (usize i = 0; i < REGION_MAX_OPEN; ++i)
+  {
+    region_t *r = &s->regions[i];
+    if (r->file && r->pos.x == region_pos.x && r->pos.y == region_pos.y)
+    {
+      WT_ASSERT(r->num_pins > 0);
+      r->num_pins -= 1;
+      return;
+    }
+  }
+}
+
+static void write_entry(region_t *r, usize idx)
+{
+  usize offset = offsetof(region_header_t, entries) + idx * sizeof(region_entry_t);
+  sys_file_seek(r->file, offset);
+  sys_file_write(r->file, &r->header.entries[idx], sizeof(region_entry_t));
+}
+
+static bool same_hash(wt_hash_u128_t a, wt_hash_u128_t b)
+{
+  return a.low == b.low && a.high == b.high;
+}
+
+// another chunk that points at the same payload, or -1
+static isize find_shared_entry(region_t *r, usize idx)
+{
+  region_entry_t *e = &r->header.entries[idx];
+  for (usize i = 0; i < REGION_NUM_CHUNKS; ++i)
+  {
+    if (i != idx && r->header.entries[i].sector == e->sector)
+    {
+      return (isize)i;
+    }
+  }
+  return -1;
+}
+
+// a stored chunk with exactly this payload, or -1. a linear scan is nothing next to the write
+static isize find_payload(region_t *r, wt_hash_u128_t hash, usize size, codec_id_t codec)
+{
+  for (usize i = 0; i < REGION_NUM_CHUNKS; ++i)
+  {
+    region_entry_t *e = &r->header.entries[i];
+    if (e->sector != 0 && entry_size(e) == size && entry_codec(e) == codec &&
+      same_hash(r->hashes[i], hash))
+    {
+      return (isize)i;
+    }
+  }
+  return -1;
+}
+
+// gives back the chunk's sectors unless another chunk still points at them
+static void release_payload(region_t *r, usize idx)
+{
+  region_entry_t *e = &r->header.entries[idx];
+  if (e->sector != 0 && find_shared_entry(r, idx) == -1)
+  {
+    mark_sectors(r, e->sector, sectors_for_size(entry_size(e)), false);
+  }
+}
+
+bool region_write_chunk(wt_vec2_t chunk_pos, void *data, usize size, codec_id_t codec)
+{
+  region_t *r = get_region(chunk_pos, true);
+  if (!r || size == 0)
+  {
+    return false;
+  }
+
+  // older regions are upgraded the first time they're written to
+  if (r->header.version != REGION_VERSION || r->header.dict_id != 0)
+  {
+    r->header.version = REGION_VERSION;
+    r->header.dict_id = 0;
+    sys_file_seek(r->file, 0);
+    sys_file_write(r->file, &r->header, sizeof(r->header));
+  }
+
+  WT_ASSERT(size <= REGION_ENTRY_SIZE_MASK);
+  usize idx = region_index_from_chunk(chunk_pos);
+  region_entry_t *e = &r->header.entries[idx];
+  wt_hash_u128_t hash = wt_hash_u128(data, size);
+
+  // nothing changed since it was last written
+  if (e->sector != 0 && entry_size(e) == size && entry_codec(e) == codec &&
+    same_hash(r->hashes[idx], hash))
+  {
+    return true;
+  }
+
+  // the same payload is already stored for another chunk, just point at it
+  isize existing = find_payload(r, hash, size, codec);
+  if (existing != -1)
+  {
+    release_payload(r, idx);
+    entry_set(e, r->header.entries[existing].sector, size, codec);
+    r->hashes[idx] = hash;
+    write_entry(r, idx);
+    return true;
+  }
+
+  u32 num_sectors = sectors_for_size(size);
+  u32 old_sectors = (e->sector != 0) ? sectors_for_size(entry_size(e)) : 0;
+  bool shared = e->sector != 0 && find_shared_entry(r, idx) != -1;
+
+  u32 sector = 0;
+  if (e->sector != 0 && !shared && num_sectors <= old_sectors)
+  {
+    // still fits where it was, give back whatever is left over
+    sector = e->sector;
+    mark_sectors(r, sector + num_sectors, old_sectors - num_sectors, false);
+  }
+  else
+  {
+    release_payload(r, idx);
+    sector = find_free_sectors(r, num_sectors);
+    if (sector == 0)
+    {
+      WT_ASSERT(false && "region is full");
+      entry_set(e, 0, 0, 0);
+      write_entry(r, idx);
+      return false;
+    }
+    mark_sectors(r, sector, num_sectors, true);
+  }
+
+  // the payload goes out before the table entry that points at it
+  if (!sys_file_seek(r->file, (usize)sector * REGION_SECTOR_SIZE) ||
+    !sys_file_write(r->file, data, size))
+  {
+    return false;
+  }
+
+  entry_set(e, sector, size, codec);
+  r->hashes[idx] = hash;
+  write_entry(r, idx);
+  return true;
+}
+
+void region_remove_chunk(wt_vec2_t chunk_pos)
+{
+  region_t *r = get_region(chunk_pos, false);
+  if (r)
+  {
+    usize idx = region_index_from_chunk(chunk_pos);
+    region_entry_t *e = &r->header.entries[idx];
+    if (e->sector != 0)
+    {
+      release_payload(r, idx);
+      entry_set(e, 0, 0, 0);
+      write_entry(r, idx);
+    }
+  }
+}
@@ -0,0 +1,32 @@
+#ifndef REGION_H
+#define REGION_H
+
+#include <wt/wt.h>
+#include "codec.h"
+
+// chunks are stored on disk in region files of REGION_SIZE x REGION_SIZE chunks.
+// each region file starts with an offset table, so single chunks can be read or rewritten in place
+#define REGION_SIZE 32
+#define REGION_NUM_CHUNKS (REGION_SIZE * REGION_SIZE)
+#define REGION_SECTOR_SIZE 4096
+#define REGION_MAX_OPEN 16
+#define REGION_FILENAME_FORMAT "test.%d.%d.region"
+
+void  region_init(void);
+void  region_close_all(void);
+
+bool  region_exists(wt_vec2_t chunk_pos);
+bool  region_has_chunk(wt_vec2_t chunk_pos);
+
+// reads the compressed chunk into scratch memory
+bool  region_read_chunk(wt_vec2_t chunk_pos, void **data, usize *size, codec_id_t *codec);
+
+// points straight at the compressed chunk inside the mapped region file. the region stays mapped
+// until region_unpin_chunk is called. only ever call these from the main thread
+bool  region_map_chunk(wt_vec2_t chunk_pos, const void **data, usize *size, codec_id_t *codec);
+void  region_unpin_chunk(wt_vec2_t chunk_pos);
+
+bool  region_write_chunk(wt_vec2_t chunk_pos, void *data, usize size, codec_id_t codec);
+void  region_remove_chunk(wt_vec2_t chunk_pos);
+
+#endif
@@ -5,6 +5,7 @@
 #include "gpu.h"
 #include "system.h"
 #include "chunk.h"
+#include "light.h"
 #include <stb_image.h>
 
 #define MAX_SOLID2D_VERTICES 1000
@@ -74,11 +75,16 @@ typedef struct
   bool is_dynamic_buffer;
 } chunk_data_footer_t;
 
-struct ren_chunk_t
+typedef struct
 {
   stretchy_buffer_t vertex_buffer, index_buffer;
-  gpu_buffer_t const_buffer;
   usize num_vertices, num_indices;
+} chunk_section_t;
+
+struct ren_chunk_t
+{
+  chunk_section_t sections[CHUNK_NUM_SECTIONS];
+  gpu_buffer_t const_buffer;
   wt_vec2_t position;
 };
 
@@ -191,8 +197,8 @@ void ren_init(void)
         .inputs[0] = { .type = GPU_DATA_UINT },
       });
 
-    void *buffer = mem_hunk_push(CHUNK_MAX * wt_align16(sizeof(struct ren_chunk_t)));
-    s->chunks.pool = wt_pool_new(buffer, CHUNK_MAX, sizeof(struct ren_chunk_t));
+    void *buffer = mem_hunk_push((CHUNK_MAX + 2) * wt_align16(sizeof(struct ren_chunk_t)));
+    s->chunks.pool = wt_pool_new(buffer, CHUNK_MAX + 2, sizeof(struct ren_chunk_t));
 
     s->chunks.data_arena = wt_arena_new(mem_hunk_push(CHUNK_DATA_ARENA_SIZE), CHUNK_DATA_ARENA_SIZE);
     s->chunks.data_arena_mutex = sys_mutex_new();
@@ -282,14 +288,18 @@ ren_chunk_t ren_chunk_new(wt_vec2_t position)
   ren_chunk_t res = wt_pool_alloc(&s->chunks.pool);
   res->position = position;
 
-  res->vertex_buffer = stretchy_buffer_new(&(gpu_buffer_desc_t){
-      .type = GPU_BUFFER_VERTEX,
-      .stride = sizeof(chunk_vertex_t),
-    });
-  res->index_buffer = stretchy_buffer_new(&(gpu_buffer_desc_t){
-      .type = GPU_BUFFER_INDEX,
-      .index_type = GPU_INDEX_U32,
-    });
+  for (usize i = 0; i < CHUNK_NUM_SECTIONS; ++i)
+  {
+    chunk_section_t *section = &res->sections[i];
+    section->vertex_buffer = stretchy_buffer_new(&(gpu_buffer_desc_t){
+        .type = GPU_BUFFER_VERTEX,
+        .stride = sizeof(chunk_vertex_t),
+      });
+    section->index_buffer = stretchy_buffer_new(&(gpu_buffer_desc_t){
+        .type = GPU_BUFFER_INDEX,
+        .index_type = GPU_INDEX_U32,
+      });
+  }
 
   res->const_buffer = gpu_buffer_new(&(gpu_buffer_desc_t){
       .size = sizeof(chunk_cbuffer_t),
@@ -300,14 +310,10 @@ ren_chunk_t ren_chunk_new(wt_vec2_t position)
   return res;
 }
 
-block_id_t world_get_block(wt_vec3_t pos);
-void ren_chunk_generate_mesh(ren_chunk_t c, block_id_t *blocks)
+ren_chunk_mesh_t ren_chunk_build_mesh(block_id_t *padded, u8 *padded_light, usize section)
 {
-  ren_state_t *s = get_state();
-  mem_scratch_begin();
-
-  usize vertices_num_bytes = sizeof(chunk_vertex_t) * 4 * 6 * CHUNK_NUM_BLOCKS;
-  usize indices_num_bytes = sizeof(u32) * 6 * 6 * CHUNK_NUM_BLOCKS;
+  usize vertices_num_bytes = sizeof(chunk_vertex_t) * REN_CHUNK_MAX_VERTICES;
+  usize indices_num_bytes = sizeof(u32) * REN_CHUNK_MAX_INDICES;
 
   chunk_vertex_t *vertices = mem_scratch_push(vertices_num_bytes);
   u32 *indices = mem_scratch_push(indices_num_bytes);
@@ -315,25 +321,28 @@ void ren_chunk_generate_mesh(ren_chunk_t c, block_id_t *blocks)
   usize num_vertices = 0;
   usize num_indices = 0;
 
-  bool shadows[CHUNK_SIZE_X * CHUNK_SIZE_Z] = { 0 };
+  const u8 *flags = block_get_flags();
+  const block_face_tiles_t *face_tiles = block_get_face_tiles();
 
-//  for (usize i = 0; i < CHUNK_NUM_BLOCKS; ++i)
-  for (isize i = CHUNK_NUM_BLOCKS - 1; i >= 0; --i)
+  isize first = section * CHUNK_SECTION_NUM_BLOCKS;
+  for (isize i = first + CHUNK_SECTION_NUM_BLOCKS - 1; i >= first; --i)
   {
-    if (blocks[i] == 0)
+    wt_vec3_t block_coords = wt_vec3(i % CHUNK_SIZE_X, i / (CHUNK_SIZE_X * CHUNK_SIZE_Z),
+      (i / CHUNK_SIZE_X) % CHUNK_SIZE_Z);
+    usize padded_idx = CHUNK_PADDED_INDEX(block_coords.x, block_coords.y, block_coords.z);
+    block_id_t *block = &padded[padded_idx];
+    if (*block == 0)
     {
       continue;
     }
 
-    block_info_t *info = block_get_info(blocks[i]);
-    WT_ASSERT(info);
-
-    u32 top_idx = info->atlas_tiles[0].x + info->atlas_tiles[0].y * 16;
-    u32 bot_idx = info->atlas_tiles[1].x + info->atlas_tiles[1].y * 16;
-    u32 fnt_idx = info->atlas_tiles[2].x + info->atlas_tiles[2].y * 16;
-    u32 bck_idx = info->atlas_tiles[3].x + info->atlas_tiles[3].y * 16;
-    u32 lft_idx = info->atlas_tiles[4].x + info->atlas_tiles[4].y * 16;
-    u32 rgt_idx = info->atlas_tiles[5].x + info->atlas_tiles[5].y * 16;
+    const u8 *tiles = face_tiles[*block];
+    u32 top_idx = tiles[BLOCK_FACE_TOP];
+    u32 bot_idx = tiles[BLOCK_FACE_BOTTOM];
+    u32 fnt_idx = tiles[BLOCK_FACE_FRONT];
+    u32 bck_idx = tiles[BLOCK_FACE_BACK];
+    u32 lft_idx = tiles[BLOCK_FACE_LEFT];
+    u32 rgt_idx = tiles[BLOCK_FACE_RIGHT];
 
     typedef struct { wt_vec3_t pos; u32 block; u32 texcoord; u32 light; } unpacked_vertex_t;
 
@@ -399,69 +408,23 @@ void ren_chunk_generate_mesh(ren_chunk_t c, block_id_t *blocks)
       0, 2, 3,
     };
 
-    f32 fi = i;
-    wt_vec3f_t block_coords = wt_vec3f(
-      fmodf(fi, CHUNK_SIZE_X),
-      fi / (CHUNK_SIZE_X * CHUNK_SIZE_Z),
-      fmodf((fi / CHUNK_SIZE_X), CHUNK_SIZE_Z));
-
-    wt_vec3_t neighbors[] = {
-      {  0,  1,  0 },
-      {  0, -1,  0 },
-      {  0,  0, -1 },
-      {  0,  0,  1 },
-      { -1,  0,  0 },
-      {  1,  0,  0 },
+    // where each neighbor is from the block in the padded volume
+    isize neighbors[] = {
+      CHUNK_PADDED_SIZE_X * CHUNK_PADDED_SIZE_Z,
+      -CHUNK_PADDED_SIZE_X * CHUNK_PADDED_SIZE_Z,
+      -CHUNK_PADDED_SIZE_X,
+      CHUNK_PADDED_SIZE_X,
+      -1,
+      1,
     };
 
-    bool *shadow = &shadows[(int)block_coords.x + (int)block_coords.z * CHUNK_SIZE_X];
-    if (*shadow)
-    {
-      block_vertices[0].light = WT_MAX(0, (int)block_vertices[0].light - 5);
-      block_vertices[1].light = WT_MAX(0, (int)block_vertices[1].light - 5);
-      block_vertices[2].light = WT_MAX(0, (int)block_vertices[2].light - 5);
-      block_vertices[3].light = WT_MAX(0, (int)block_vertices[3].light - 5);
-    }
-    *shadow = true;
-
+    // a face is hidden by an opaque neighbor, and between two fluids
+    u8 hidden_by = BLOCK_FLAG_OPAQUE | (flags[*block] & BLOCK_FLAG_FLUID);
     for (usize j = 0; j < 6; ++j)
     {
-      wt_vec3_t neighbor_offset = neighbors[j];
-      wt_vec3_t neighbor = wt_vec3i_add(wt_vec3f_to_vec3i(block_coords), neighbor_offset);
-
-      // if the block has a solid neighbor, we can skip drawing this face
-      bool out_of_bounds =
-        (neighbor.x < 0 || neighbor.x >= CHUNK_SIZE_X) ||
-        (neighbor.y < 0 || neighbor.y >= CHUNK_SIZE_Y) ||
-        (neighbor.z < 0 || neighbor.z >= CHUNK_SIZE_Z);
-
-      block_id_t neighbor_id = 0;
-      if (neighbor.y >= 0)
+      if (flags[block[neighbors[j]]] & hidden_by)
       {
-        if (out_of_bounds)
-        {
-          wt_vec2_t chunk_pos = wt_vec2i_mul_i32(c->position, 16);
-          neighbor.x += chunk_pos.x;
-          neighbor.z += chunk_pos.y;
-          if (neighbor.y >= 0 && neighbor.y < CHUNK_SIZE_Y)
-          {
-            neighbor_id = world_get_block(neighbor);
-          }
-        }
-        else
-        {
-          neighbor_id = blocks[neighbor.x + (neighbor.z * CHUNK_SIZE_Z) +
-            (neighbor.y * CHUNK_SIZE_X * CHUNK_SIZE_Z)];
-        }
-      }
-
-      if (neighbor_id != 0)
-      {
-        block_info_t *neighbor_info = block_get_info(neighbor_id);
-        if (!neighbor_info || neighbor_info->solid)
-        {
-          continue;
-        }
+        continue;
       }
 
       for (usize k = 0; k < 6; ++k)
@@ -469,11 +432,16 @@ void ren_chunk_generate_mesh(ren_chunk_t c, block_id_t *blocks)
         indices[num_indices++] = block_indices[j * 6 + k] + num_vertices;
       }
 
+      // a face is as lit as the block in front of it, by the sky or a block, whichever is brighter
+      u8 light = padded_light[padded_idx + neighbors[j]];
+      u32 level = WT_MAX(LIGHT_SKY(light), LIGHT_BLOCK(light));
+
       for (usize k = 0; k < 4; ++k)
       {
         unpacked_vertex_t u = block_vertices[j * 4 + k];
+        u.light = u.light * level / LIGHT_MAX;
         chunk_vertex_t p = 0;
-        u.pos = wt_vec3i_add(u.pos, wt_vec3f_to_vec3i(block_coords));
+        u.pos = wt_vec3i_add(u.pos, block_coords);
         p |= u.pos.x    << (32 - 5);
         p |= u.pos.z    << (32 - 10);
         p |= u.pos.y    << (32 - 18);
@@ -485,6 +453,19 @@ void ren_chunk_generate_mesh(ren_chunk_t c, block_id_t *blocks)
     }
   }
 
+  ren_chunk_mesh_t res = { 0 };
+  res.vertices = vertices;
+  res.indices = indices;
+  res.num_vertices = num_vertices;
+  res.num_indices = num_indices;
+  return res;
+}
+
+void ren_chunk_upload_mesh(ren_chunk_t c, usize section, ren_chunk_mesh_t *mesh)
+{
+  chunk_section_t *sec = &c->sections[section];
+  ren_state_t *s = get_state();
+
   chunk_cbuffer_t cbuffer_data = { 0 };
   cbuffer_data.position = wt_vec2f(c->position.x * CHUNK_SIZE_X, c->position.y * CHUNK_SIZE_Z);
   cbuffer_data.rc_atlas_size = wt_vec2f_div(wt_vec2f(1.0f, 1.0f), wt_vec2f(256.0f, 256.0f));
@@ -499,32 +480,65 @@ void ren_chunk_generate_mesh(ren_chunk_t c, block_id_t *blocks)
     wt_arena_push_from(&s->chunks.data_arena, &cbuffer_data, sizeof(cbuffer_data));
     wt_arena_push_from(&s->chunks.data_arena, &footer, sizeof(footer));
 
-    footer.buffer = &c->vertex_buffer;
-    footer.num_bytes = num_vertices * sizeof(chunk_vertex_t);
+    footer.buffer = &sec->vertex_buffer;
+    footer.num_bytes = mesh->num_vertices * sizeof(chunk_vertex_t);
     footer.is_dynamic_buffer = true;
-    wt_arena_push_from(&s->chunks.data_arena, vertices, footer.num_bytes);
+    wt_arena_push_from(&s->chunks.data_arena, mesh->vertices, footer.num_bytes);
     wt_arena_push_from(&s->chunks.data_arena, &footer, sizeof(footer));
 
-    footer.buffer = &c->index_buffer;
-    footer.num_bytes = num_indices * sizeof(u32);
+    footer.buffer = &sec->index_buffer;
+    footer.num_bytes = mesh->num_indices * sizeof(u32);
     footer.is_dynamic_buffer = true;
-    wt_arena_push_from(&s->chunks.data_arena, indices, footer.num_bytes);
+    wt_arena_push_from(&s->chunks.data_arena, mesh->indices, footer.num_bytes);
     wt_arena_push_from(&s->chunks.data_arena, &footer, sizeof(footer));
 
     sys_mutex_unlock(s->chunks.data_arena_mutex);
   }
 
-  c->num_vertices = num_vertices;
-  c->num_indices = num_indices;
+  sec->num_vertices = mesh->num_vertices;
+  sec->num_indices = mesh->num_indices;
+}
+
+// update any chunk meshes received from the worker threads
+static void flush_chunk_uploads(void)
+{
+  ren_state_t *s = get_state();
+  sys_mutex_lock(s->chunks.data_arena_mutex);
+  while (s->chunks.data_arena.pos > 0)
+  {
+    chunk_data_footer_t footer = { 0 };
+    memcpy(&footer, wt_arena_get_last(&s->chunks.data_arena, sizeof(footer)), sizeof(footer));
+    wt_arena_pop(&s->chunks.data_arena, sizeof(footer));
+
+    void *data = wt_arena_get_last(&s->chunks.data_arena, footer.num_bytes);
+    if (footer.is_dynamic_buffer)
+    {
+      stretchy_buffer_update(footer.buffer, data, footer.num_bytes);
+    }
+    else
+    {
+      gpu_buffer_update(footer.buffer, data, footer.num_bytes);
+    }
+
+    wt_arena_pop(&s->chunks.data_arena, footer.num_bytes);
+  }
 
-  mem_scratch_end();
+  sys_mutex_unlock(s->chunks.data_arena_mutex);
 }
 
 void ren_chunk_free(ren_chunk_t c)
 {
   ren_state_t *s = get_state();
-  gpu_buffer_free(c->vertex_buffer.buffer);
-  gpu_buffer_free(c->index_buffer.buffer);
+
+  // a finished mesh job might still have data queued up for this chunk's buffers
+  flush_chunk_uploads();
+
+  for (usize i = 0; i < CHUNK_NUM_SECTIONS; ++i)
+  {
+    chunk_section_t *section = &c->sections[i];
+    if (section->vertex_buffer.buffer) { gpu_buffer_free(section->vertex_buffer.buffer); }
+    if (section->index_buffer.buffer)  { gpu_buffer_free(section->index_buffer.buffer); }
+  }
   gpu_buffer_free(c->const_buffer);
   wt_pool_free(&s->chunks.pool, c);
 }
@@ -681,31 +695,7 @@ void ren_draw_rect(wt_rect_t rect, wt_color_t color)
 
 void ren_frame_end(void)
 {
-  ren_state_t *s = get_state();
-
-  // update any chunk meshes received from the worker threads
-  sys_mutex_lock(s->chunks.data_arena_mutex);
-  while (s->chunks.data_arena.pos > 0)
-  {
-    chunk_data_footer_t footer = { 0 };
-    memcpy(&footer, wt_arena_get_last(&s->chunks.data_arena, sizeof(footer)), sizeof(footer));
-    wt_arena_pop(&s->chunks.data_arena, sizeof(footer));
-
-    void *data = wt_arena_get_last(&s->chunks.data_arena, footer.num_bytes);
-    if (footer.is_dynamic_buffer)
-    {
-      stretchy_buffer_update(footer.buffer, data, footer.num_bytes);
-    }
-    else
-    {
-      gpu_buffer_update(footer.buffer, data, footer.num_bytes);
-    }
-
-    wt_arena_pop(&s->chunks.data_arena, footer.num_bytes);
-  }
-
-  sys_mutex_unlock(s->chunks.data_arena_mutex);
-
+  flush_chunk_uploads();
   flush2d();
   gpu_frame_end();
 }
@@ -742,15 +732,26 @@ void ren_draw_sprite_ex(ren_texture_t tx, wt_rect_t src, wt_rect_t dst,
 void ren_draw_chunk(ren_chunk_t c)
 {
   ren_state_t *s = get_state();
-  if (c->vertex_buffer.buffer && c->index_buffer.buffer)
+  bool bound = false;
+  for (usize i = 0; i < CHUNK_NUM_SECTIONS; ++i)
   {
-    flush2d();
+    chunk_section_t *section = &c->sections[i];
+    if (!section->vertex_buffer.buffer || !section->index_buffer.buffer || section->num_indices == 0)
+    {
+      continue;
+    }
+
+    if (!bound)
+    {
+      flush2d();
+      gpu_buffer_bind(c->const_buffer, 1);
+      gpu_shader_bind(s->chunks.shader);
+      gpu_texture_bind(s->chunks.atlas.texture, 0);
+      bound = true;
+    }
 
-    gpu_buffer_bind(c->vertex_buffer.buffer, 0);
-    gpu_buffer_bind(c->index_buffer.buffer, 0);
-    gpu_buffer_bind(c->const_buffer, 1);
-    gpu_shader_bind(s->chunks.shader);
-    gpu_texture_bind(s->chunks.atlas.texture, 0);
-    gpu_draw_indexed(GPU_PRIMITIVE_TRIANGLES, 0, c->num_indices);
+    gpu_buffer_bind(section->vertex_buffer.buffer, 0);
+    gpu_buffer_bind(section->index_buffer.buffer, 0);
+    gpu_draw_indexed(GPU_PRIMITIVE_TRIANGLES, 0, section->num_indices);
   }
 }
@@ -4,6 +4,11 @@
 #include <wt/wt.h>
 #include "block.h"
 #include "gpu.h"
+#include "constants.h"
+
+// the most a section's mesh can hold, every face of every block in it
+#define REN_CHUNK_MAX_VERTICES (4 * 6 * CHUNK_SECTION_NUM_BLOCKS)
+#define REN_CHUNK_MAX_INDICES (6 * 6 * CHUNK_SECTION_NUM_BLOCKS)
 
 typedef struct
 {
@@ -13,6 +18,14 @@ typedef struct
 
 typedef struct ren_chunk_t *ren_chunk_t;
 
+// a chunk mesh that's been built (or read back from the mesh cache) but not uploaded yet
+typedef struct
+{
+  u32 *vertices;
+  u32 *indices;
+  usize num_vertices, num_indices;
+} ren_chunk_mesh_t;
+
 void          ren_init(void);
 
 // todo: get rid of window size parameter, as it is now useless
@@ -24,7 +37,11 @@ ren_texture_t ren_texture_load_from_file(const char *filename);
 void          ren_texture_free(ren_texture_t tx);
 
 ren_chunk_t   ren_chunk_new(wt_vec2_t position);
-void          ren_chunk_generate_mesh(ren_chunk_t c, block_id_t *blocks);
+// builds the mesh of one section in scratch memory from the chunk's padded blocks and their light
+// (see chunk_get_padded)
+ren_chunk_mesh_t ren_chunk_build_mesh(block_id_t *padded, u8 *padded_light, usize section);
+// can be called from any thread, the buffers are updated on the main thread
+void          ren_chunk_upload_mesh(ren_chunk_t c, usize section, ren_chunk_mesh_t *mesh);
 void          ren_chunk_free(ren_chunk_t c);
 
 void          ren_camera_set(wt_mat4x4_t mtx);
@@ -25,11 +25,28 @@ typedef struct
   usize size;
 } sys_file_contents_t;
 
+typedef struct
+{
+  byte_t *data;
+  usize size;
+  void *handle;
+} sys_file_mapping_t;
+
 sys_file_t          sys_file_open(const char *filename, sys_file_access_t access);
 usize               sys_file_get_size(sys_file_t file);
 bool                sys_file_read(sys_file_t file, void *buf, usize num_bytes);
 sys_file_contents_t sys_file_read_to_scratch_buffer(const char *filename, bool null_terminator);
 bool                sys_file_write(sys_file_t file, void *buf, usize num_bytes);
+bool                sys_file_seek(sys_file_t file, usize offset);
+// waits until everything written so far is on the disk, not just in the os's cache
+bool                sys_file_flush(sys_file_t file);
+// replaces whatever is at new_filename, which can't be open
+bool                sys_file_rename(const char *filename, const char *new_filename);
+
+// maps the whole file read-only. writes made through the file handle afterwards show up in the
+// mapping, as long as they don't go past the end of what was mapped
+sys_file_mapping_t  sys_file_map(sys_file_t file);
+void                sys_file_unmap(sys_file_mapping_t *mapping);
 void                sys_file_close(sys_file_t file);
 
 // === user input ===
@@ -104,4 +121,12 @@ bool         sys_mutex_try_lock(sys_mutex_t mtx);
 void         sys_mutex_unlock(sys_mutex_t mtx);
 void         sys_mutex_free(sys_mutex_t mtx);
 
+// === atomics ===
+
+// all return the value *before* the operation
+i32          sys_atomic_add(volatile i32 *x, i32 value);
+i32          sys_atomic_exchange(volatile i32 *x, i32 value);
+// only stores value if *x == comparand
+i32          sys_atomic_compare_exchange(volatile i32 *x, i32 value, i32 comparand);
+
 #endif
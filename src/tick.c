@@ -0,0 +1,514 @@
+#include "tick.h"
+#include "game.h"
+#include "memory.h"
+#include "job.h"
+#include "world.h"
+#include "region.h"
+#include "light.h"
+#include "fluid.h"
+#include "constants.h"
+#include <stdlib.h>
+#include <string.h>
+
+// regions are ticked in parallel, a job each
+#define TICK_REGIONS_X (WORLD_MAX_CHUNKS_X / REGION_SIZE)
+#define TICK_MAX_REGIONS (TICK_REGIONS_X * (WORLD_MAX_CHUNKS_Z / REGION_SIZE))
+
+// how much a region's tick can change, anything past it is dropped
+#define TICK_MAX_REGION_EDITS 65536
+#define TICK_MAX_REGION_REQUESTS 65536
+
+// the furthest out the wheel reaches without a deadline landing in the slot that's running
+#define TICK_MAX_DELAY ((1u << (TICK_WHEEL_SHIFT * TICK_WHEEL_LEVELS)) - \
+  (1u << (TICK_WHEEL_SHIFT * (TICK_WHEEL_LEVELS - 1))))
+
+#define TICK_NONE 0xffffffffu
+
+// leaves without a log this many blocks away (on every axis) decay, each a little after the last
+#define TICK_LEAF_RANGE 4
+#define TICK_LEAF_DECAY_DELAY 8
+
+// grass spreads onto dirt that has at least this much light above it
+#define TICK_GRASS_MIN_LIGHT 9
+
+// positions are packed into 10 bits for x and z, and 8 for y
+#define TICK_PACK(pos) ((u32)(pos).x | ((u32)(pos).z << 10) | ((u32)(pos).y << 20))
+#define TICK_UNPACK(p) wt_vec3((p) & 0x3ff, (p) >> 20, ((p) >> 10) & 0x3ff)
+
+static const wt_vec3_t k_dirs[] = { { 0, -1, 0 }, { 0, 1, 0 }, { -1, 0, 0 }, { 1, 0, 0 }, { 0, 0, -1 }, { 0, 0, 1 } };
+
+typedef struct
+{
+  u64 deadline;
+  u32 pos;
+  u32 next; // in the same slot, or in the free list
+} tick_entry_t;
+
+typedef struct
+{
+  u32 pos;
+  u32 delay;
+} tick_request_t;
+
+// a region's share of a tick. its job only reads the world, what it wants changed is handed back
+// and applied on the main thread once every region is done, in region order
+typedef struct
+{
+  u64 tick;
+  chunk_t *chunks[REGION_NUM_CHUNKS]; // ready and within a ticket, in index order
+  usize num_chunks;
+  u32 *due; // scheduled positions, in the order they were scheduled in
+  usize num_due;
+
+  world_edit_t *edits;
+  usize num_edits;
+  tick_request_t *requests;
+  usize num_requests;
+} tick_region_t;
+
+typedef struct
+{
+  tick_entry_t *entries;
+  u32 free_list;
+  usize num_scheduled;
+
+  // first entry in each slot. level 0 slots are single ticks, each slot on the level above covers
+  // a whole turn of the one below
+  u32 wheel[TICK_WHEEL_LEVELS][TICK_WHEEL_SLOTS];
+  u64 now; // the tick that runs next
+  f64 time; // left over from the last update
+
+  u32 *due;
+  tick_region_t regions[TICK_MAX_REGIONS];
+  volatile i32 region_jobs;
+} tick_state_t;
+
+static tick_state_t *get_state(void)
+{
+  return game_get_state()->modules.tick;
+}
+
+void tick_init(void)
+{
+  game_state_t *gs = game_get_state();
+  tick_state_t *s = gs->modules.tick = mem_hunk_push(sizeof(tick_state_t));
+
+  s->entries = mem_hunk_push(TICK_MAX_SCHEDULED * sizeof(tick_entry_t));
+  for (u32 i = 0; i < TICK_MAX_SCHEDULED; ++i)
+  {
+    s->entries[i].next = i + 1 < TICK_MAX_SCHEDULED ? i + 1 : TICK_NONE;
+  }
+  memset(s->wheel, 0xff, sizeof(s->wheel));
+
+  s->due = mem_hunk_push(TICK_MAX_SCHEDULED * sizeof(u32));
+  for (usize i = 0; i < TICK_MAX_REGIONS; ++i)
+  {
+    s->regions[i].edits = mem_hunk_push(TICK_MAX_REGION_EDITS * sizeof(world_edit_t));
+    s->regions[i].requests = mem_hunk_push(TICK_MAX_REGION_REQUESTS * sizeof(tick_request_t));
+  }
+}
+
+// the lowest level whose slots tell the deadline apart from now
+static void wheel_insert(u32 idx)
+{
+  tick_state_t *s = get_state();
+  tick_entry_t *e = &s->entries[idx];
+  usize level = 0;
+  while (level < TICK_WHEEL_LEVELS - 1 &&
+    (e->deadline >> (TICK_WHEEL_SHIFT * (level + 1))) != (s->now >> (TICK_WHEEL_SHIFT * (level + 1))))
+  {
+    ++level;
+  }
+
+  u32 *slot = &s->wheel[level][(e->deadline >> (TICK_WHEEL_SHIFT * level)) & (TICK_WHEEL_SLOTS - 1)];
+  e->next = *slot;
+  *slot = idx;
+}
+
+void tick_schedule(wt_vec3_t pos, u32 delay)
+{
+  tick_state_t *s = get_state();
+  if (s->free_list == TICK_NONE || !world_within_bounds(pos))
+  {
+    return;
+  }
+
+  u32 idx = s->free_list;
+  tick_entry_t *e = &s->entries[idx];
+  s->free_list = e->next;
+  ++s->num_scheduled;
+
+  // a delay of 1 is the next tick that runs
+  e->deadline = s->now + WT_MIN(WT_MAX(delay, 1), TICK_MAX_DELAY) - 1;
+  e->pos = TICK_PACK(pos);
+  wheel_insert(idx);
+}
+
+usize tick_get_num_scheduled(void)
+{
+  return get_state()->num_scheduled;
+}
+
+u64 tick_get_current(void)
+{
+  return get_state()->now;
+}
+
+// once now starts a new turn of a level, the slot it's come to is spread over the levels below
+static void wheel_cascade(void)
+{
+  tick_state_t *s = get_state();
+  for (usize level = TICK_WHEEL_LEVELS - 1; level > 0; --level)
+  {
+    if (s->now & ((1ull << (TICK_WHEEL_SHIFT * level)) - 1))
+    {
+      continue;
+    }
+
+    u32 *slot = &s->wheel[level][(s->now >> (TICK_WHEEL_SHIFT * level)) & (TICK_WHEEL_SLOTS - 1)];
+    u32 idx = *slot;
+    *slot = TICK_NONE;
+    while (idx != TICK_NONE)
+    {
+      u32 next = s->entries[idx].next;
+      wheel_insert(idx);
+      idx = next;
+    }
+  }
+}
+
+static u64 mix(u64 x)
+{
+  x += 0x9e3779b97f4a7c15ull;
+  x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+  x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+  return x ^ (x >> 31);
+}
+
+// xorshift64*, its state is never 0
+static u64 next_random(u64 *x)
+{
+  *x ^= *x >> 12;
+  *x ^= *x << 25;
+  *x ^= *x >> 27;
+  return *x * 0x2545f4914f6cdd1dull;
+}
+
+// the chunk holding pos if it's ready, and the block's index in it
+static chunk_t *ready_chunk(wt_vec3_t pos, usize *idx)
+{
+  if (pos.y < 0 || pos.y >= CHUNK_SIZE_Y)
+  {
+    return NULL;
+  }
+
+  chunk_t *c = world_get_chunk(wt_vec2(pos.x >> CHUNK_SHIFT_X, pos.z >> CHUNK_SHIFT_Z));
+  *idx = (pos.x & (CHUNK_SIZE_X - 1)) | ((pos.z & (CHUNK_SIZE_Z - 1)) << CHUNK_SHIFT_X) |
+    (pos.y << (CHUNK_SHIFT_X + CHUNK_SHIFT_Z));
+  return c && c->status == CHUNK_STATUS_READY ? c : NULL;
+}
+
+static void add_edit(tick_region_t *r, wt_vec3_t pos, block_id_t block)
+{
+  if (r->num_edits < TICK_MAX_REGION_EDITS)
+  {
+    r->edits[r->num_edits++] = (world_edit_t){ pos, block };
+  }
+}
+
+static void add_request(tick_region_t *r, wt_vec3_t pos, u32 delay)
+{
+  if (r->num_requests < TICK_MAX_REGION_REQUESTS)
+  {
+    r->requests[r->num_requests++] = (tick_request_t){ TICK_PACK(pos), delay };
+  }
+}
+
+static u32 leaf_decay_delay(wt_vec3_t pos, u64 tick)
+{
+  return TICK_LEAF_DECAY_DELAY + (mix(TICK_PACK(pos) ^ (tick << 32)) % TICK_LEAF_DECAY_DELAY);
+}
+
+// leaves that aren't held up by a log anymore decay, then their neighbors get checked
+static void tick_leaves(tick_region_t *r, wt_vec3_t pos)
+{
+  for (i32 dy = -TICK_LEAF_RANGE; dy <= TICK_LEAF_RANGE; ++dy)
+  {
+    for (i32 dz = -TICK_LEAF_RANGE; dz <= TICK_LEAF_RANGE; ++dz)
+    {
+      for (i32 dx = -TICK_LEAF_RANGE; dx <= TICK_LEAF_RANGE; ++dx)
+      {
+        wt_vec3_t p = wt_vec3(pos.x + dx, pos.y + dy, pos.z + dz);
+        usize idx = 0;
+        chunk_t *c = ready_chunk(p, &idx);
+
+        // a log could be in a chunk that isn't ready yet
+        if ((!c && world_within_bounds(p)) || (c && c->data->blocks[idx] == BLOCK_LOG))
+        {
+          return;
+        }
+      }
+    }
+  }
+
+  add_edit(r, pos, BLOCK_AIR);
+  for (usize dir = 0; dir < WT_ARRAY_COUNT(k_dirs); ++dir)
+  {
+    wt_vec3_t n = wt_vec3i_add(pos, k_dirs[dir]);
+    usize idx = 0;
+    chunk_t *c = ready_chunk(n, &idx);
+    if (c && c->data->blocks[idx] == BLOCK_LEAVES)
+    {
+      add_request(r, n, leaf_decay_delay(n, r->tick));
+    }
+  }
+}
+
+static void tick_scheduled(tick_region_t *r, wt_vec3_t pos)
+{
+  usize idx = 0;
+  chunk_t *c = ready_chunk(pos, &idx);
+  if (!c)
+  {
+    return;
+  }
+
+  switch (c->data->blocks[idx])
+  {
+    case BLOCK_LEAVES: tick_leaves(r, pos); break;
+    default: break;
+  }
+}
+
+// grass dies under anything opaque, and spreads onto lit dirt next to it
+static void tick_random(tick_region_t *r, chunk_t *c, wt_vec3_t pos, usize idx)
+{
+  const u8 *flags = block_get_flags();
+  block_id_t block = c->data->blocks[idx];
+  if (block != BLOCK_GRASS_BLOCK && block != BLOCK_DIRT)
+  {
+    return;
+  }
+
+  usize above_idx = 0;
+  chunk_t *above = ready_chunk(wt_vec3(pos.x, pos.y + 1, pos.z), &above_idx);
+  bool covered = above && !(flags[above->data->blocks[above_idx]] & BLOCK_FLAG_TRANSPARENT);
+  if (block == BLOCK_GRASS_BLOCK)
+  {
+    if (covered)
+    {
+      add_edit(r, pos, BLOCK_DIRT);
+    }
+    return;
+  }
+
+  u8 light = above ? above->data->light[above_idx] : 0;
+  if (!above || covered || WT_MAX(LIGHT_SKY(light), LIGHT_BLOCK(light)) < TICK_GRASS_MIN_LIGHT)
+  {
+    return;
+  }
+
+  for (i32 dy = -1; dy <= 1; ++dy)
+  {
+    for (i32 dz = -1; dz <= 1; ++dz)
+    {
+      for (i32 dx = -1; dx <= 1; ++dx)
+      {
+        usize n_idx = 0;
+        chunk_t *n = ready_chunk(wt_vec3(pos.x + dx, pos.y + dy, pos.z + dz), &n_idx);
+        if (n && n->data->blocks[n_idx] == BLOCK_GRASS_BLOCK)
+        {
+          add_edit(r, pos, BLOCK_GRASS_BLOCK);
+          return;
+        }
+      }
+    }
+  }
+}
+
+// only reads the world, the main thread waits for every region before anything changes
+static void region_job(void *param)
+{
+  tick_region_t *r = (tick_region_t*)param;
+  for (usize i = 0; i < r->num_due; ++i)
+  {
+    tick_scheduled(r, TICK_UNPACK(r->due[i]));
+  }
+
+  // the blocks picked only depend on the tick, the seed and the chunk, not on what else is loaded
+  for (usize i = 0; i < r->num_chunks; ++i)
+  {
+    chunk_t *c = r->chunks[i];
+    wt_vec3_t origin = wt_vec3(c->position.x * CHUNK_SIZE_X, 0, c->position.y * CHUNK_SIZE_Z);
+    u64 rng = mix(mix(r->tick ^ ((u64)world_get_seed() << 32)) ^
+      (u64)(c->position.x + c->position.y * WORLD_MAX_CHUNKS_X)) | 1;
+    for (usize section = 0; section < CHUNK_NUM_SECTIONS; ++section)
+    {
+      for (usize j = 0; j < TICK_RANDOM_TICKS_PER_SECTION; ++j)
+      {
+        usize idx = (next_random(&rng) >> 40) & (CHUNK_SECTION_NUM_BLOCKS - 1);
+        idx += section * CHUNK_SECTION_NUM_BLOCKS;
+        wt_vec3_t pos = wt_vec3(origin.x + (idx & (CHUNK_SIZE_X - 1)), idx >> (CHUNK_SHIFT_X + CHUNK_SHIFT_Z),
+          origin.z + ((idx >> CHUNK_SHIFT_X) & (CHUNK_SIZE_Z - 1)));
+        tick_random(r, c, pos, idx);
+      }
+    }
+  }
+}
+
+static usize region_of(wt_vec3_t pos)
+{
+  return (pos.x >> CHUNK_SHIFT_X) / REGION_SIZE + ((pos.z >> CHUNK_SHIFT_Z) / REGION_SIZE) * TICK_REGIONS_X;
+}
+
+static int compare_chunks(const void *a, const void *b)
+{
+  const chunk_t *ca = *(const chunk_t**)a;
+  const chunk_t *cb = *(const chunk_t**)b;
+  i32 ia = ca->position.x + ca->position.y * WORLD_MAX_CHUNKS_X;
+  i32 ib = cb->position.x + cb->position.y * WORLD_MAX_CHUNKS_X;
+  return (ia > ib) - (ia < ib);
+}
+
+void tick_run(void)
+{
+  tick_state_t *s = get_state();
+  u64 tick = s->now;
+  wheel_cascade();
+
+  // take everything due off the wheel
+  usize num_due = 0;
+  u32 *slot = &s->wheel[0][tick & (TICK_WHEEL_SLOTS - 1)];
+  u32 idx = *slot;
+  *slot = TICK_NONE;
+  while (idx != TICK_NONE)
+  {
+    tick_entry_t *e = &s->entries[idx];
+    u32 next = e->next;
+    s->due[num_due++] = e->pos;
+    e->next = s->free_list;
+    s->free_list = idx;
+    --s->num_scheduled;
+    idx = next;
+  }
+
+  // hand each region its share, keeping the order things were scheduled in
+  u32 counts[TICK_MAX_REGIONS + 1] = { 0 };
+  for (usize i = 0; i < num_due; ++i)
+  {
+    counts[region_of(TICK_UNPACK(s->due[i])) + 1] += 1;
+  }
+  for (usize i = 0; i < TICK_MAX_REGIONS; ++i)
+  {
+    counts[i + 1] += counts[i];
+  }
+
+  mem_scratch_begin();
+  u32 *sorted = mem_scratch_push((num_due + 1) * sizeof(u32));
+  for (usize i = 0; i < num_due; ++i)
+  {
+    sorted[counts[region_of(TICK_UNPACK(s->due[i]))]++] = s->due[i];
+  }
+
+  chunk_t **chunks = mem_scratch_push(WORLD_MAX_CHUNKS * sizeof(chunk_t*));
+  usize num_chunks = world_get_ticking_chunks(chunks, WORLD_MAX_CHUNKS);
+  for (usize i = 0; i < TICK_MAX_REGIONS; ++i)
+  {
+    tick_region_t *r = &s->regions[i];
+    r->tick = tick;
+    r->due = sorted + (i > 0 ? counts[i - 1] : 0);
+    r->num_due = counts[i] - (i > 0 ? counts[i - 1] : 0);
+    r->num_chunks = 0;
+    r->num_edits = 0;
+    r->num_requests = 0;
+  }
+  for (usize i = 0; i < num_chunks; ++i)
+  {
+    wt_vec2_t p = chunks[i]->position;
+    tick_region_t *r = &s->regions[p.x / REGION_SIZE + (p.y / REGION_SIZE) * TICK_REGIONS_X];
+    r->chunks[r->num_chunks++] = chunks[i];
+  }
+
+  // the first region with anything to do runs right here instead of waiting on a worker
+  tick_region_t *local = NULL;
+  for (usize i = 0; i < TICK_MAX_REGIONS; ++i)
+  {
+    tick_region_t *r = &s->regions[i];
+    qsort(r->chunks, r->num_chunks, sizeof(chunk_t*), compare_chunks);
+    if (!r->num_due && !r->num_chunks)
+    {
+      continue;
+    }
+    else if (!local)
+    {
+      local = r;
+    }
+    else
+    {
+      job_queue_counted(region_job, r, &s->region_jobs);
+    }
+  }
+  if (local)
+  {
+    region_job(local);
+  }
+  job_wait(&s->region_jobs);
+  mem_scratch_end();
+
+  ++s->now;
+  for (usize i = 0; i < TICK_MAX_REGIONS; ++i)
+  {
+    tick_region_t *r = &s->regions[i];
+    world_set_blocks(r->edits, r->num_edits);
+
+    for (usize j = 0; j < r->num_requests; ++j)
+    {
+      tick_schedule(TICK_UNPACK(r->requests[j].pos), r->requests[j].delay);
+    }
+  }
+
+  // fluids step on block ticks too, after everything else has changed
+  fluid_tick(tick);
+}
+
+void tick_update(f64 dt)
+{
+  tick_state_t *s = get_state();
+  s->time += dt;
+  for (usize i = 0; i < TICK_MAX_PER_FRAME && s->time >= 1.0 / TICK_RATE; ++i)
+  {
+    tick_run();
+    s->time -= 1.0 / TICK_RATE;
+  }
+  if (s->time >= 1.0 / TICK_RATE)
+  {
+    s->time = 0;
+  }
+}
+
+void tick_block_changed(wt_vec3_t pos, block_id_t old_block, block_id_t block)
+{
+  if (old_block != BLOCK_LOG || block == BLOCK_LOG)
+  {
+    return;
+  }
+
+  // every leaf the log might have been holding up gets checked
+  u64 now = get_state()->now;
+  for (i32 dy = -TICK_LEAF_RANGE; dy <= TICK_LEAF_RANGE; ++dy)
+  {
+    for (i32 dz = -TICK_LEAF_RANGE; dz <= TICK_LEAF_RANGE; ++dz)
+    {
+      for (i32 dx = -TICK_LEAF_RANGE; dx <= TICK_LEAF_RANGE; ++dx)
+      {
+        wt_vec3_t p = wt_vec3(pos.x + dx, pos.y + dy, pos.z + dz);
+        usize idx = 0;
+        chunk_t *c = ready_chunk(p, &idx);
+        if (c && c->data->blocks[idx] == BLOCK_LEAVES)
+        {
+          tick_schedule(p, leaf_decay_delay(p, now));
+        }
+      }
+    }
+  }
+}
@@ -0,0 +1,38 @@
+#ifndef TICK_H
+#define TICK_H
+
+#include <wt/wt.h>
+#include "block.h"
+
+// blocks are ticked at a fixed rate, separate from the frame rate. a frame that falls behind runs a
+// few ticks to catch up, anything past that is dropped
+#define TICK_RATE 20
+#define TICK_MAX_PER_FRAME 4
+
+// scheduled ticks wait in a timing wheel of TICK_WHEEL_LEVELS levels, each TICK_WHEEL_SLOTS ticks
+// finer than the one above it. anything further out than the wheel reaches is clamped to its end
+#define TICK_WHEEL_SHIFT 6
+#define TICK_WHEEL_SLOTS (1 << TICK_WHEEL_SHIFT)
+#define TICK_WHEEL_LEVELS 4
+#define TICK_MAX_SCHEDULED (1 << 18)
+
+// every tick, this many blocks are picked at random in each section of the chunks within a ticket.
+// whatever they change marks the chunk modified like any other edit, so it gets saved
+#define TICK_RANDOM_TICKS_PER_SECTION 3
+
+void tick_init(void);
+
+// runs as many block ticks as dt seconds worth, see TICK_RATE
+void tick_update(f64 dt);
+void tick_run(void);
+u64  tick_get_current(void);
+
+// ticks the block at pos delay ticks from now. if there's no room left the tick is dropped.
+// scheduled ticks aren't saved, whatever is still waiting when the world closes never happens
+void tick_schedule(wt_vec3_t pos, u32 delay);
+usize tick_get_num_scheduled(void);
+
+// called by the world for every block that changes, schedules whatever reacts to it
+void tick_block_changed(wt_vec3_t pos, block_id_t old_block, block_id_t block);
+
+#endif
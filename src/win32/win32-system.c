@@ -267,6 +267,7 @@ sys_file_t sys_file_open(const char *filename, sys_file_access_t access)
   DWORD creation_disposition = 0;
   if (write) { creation_disposition = CREATE_ALWAYS; }
   if (read)  { creation_disposition = OPEN_EXISTING; }
+  if (read && write) { creation_disposition = OPEN_ALWAYS; } // don't truncate files we update in place
 
   HANDLE hdl = CreateFileA(filename, desired_access, FILE_SHARE_READ, NULL,
     creation_disposition, FILE_ATTRIBUTE_NORMAL, NULL);
@@ -309,6 +310,62 @@ bool sys_file_write(sys_file_t file, void *buf, usize num_bytes)
   return WriteFile(file, buf, num_bytes, &useless, NULL);
 }
 
+bool sys_file_seek(sys_file_t file, usize offset)
+{
+  LARGE_INTEGER li = { 0 };
+  li.QuadPart = offset;
+  return SetFilePointerEx(file, li, NULL, FILE_BEGIN);
+}
+
+bool sys_file_flush(sys_file_t file)
+{
+  return FlushFileBuffers(file);
+}
+
+bool sys_file_rename(const char *filename, const char *new_filename)
+{
+  return MoveFileExA(filename, new_filename, MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH);
+}
+
+sys_file_mapping_t sys_file_map(sys_file_t file)
+{
+  sys_file_mapping_t res = { 0 };
+
+  // empty files can't be mapped
+  usize size = sys_file_get_size(file);
+  if (size == 0)
+  {
+    return res;
+  }
+
+  HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+  if (mapping)
+  {
+    void *view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    if (view)
+    {
+      res.data = view;
+      res.size = size;
+      res.handle = mapping;
+    }
+    else
+    {
+      CloseHandle(mapping);
+    }
+  }
+  return res;
+}
+
+void sys_file_unmap(sys_file_mapping_t *mapping)
+{
+  if (mapping->data)
+  {
+    UnmapViewOfFile(mapping->data);
+    CloseHandle(mapping->handle);
+  }
+  memset(mapping, 0, sizeof(*mapping));
+}
+
 void sys_file_close(sys_file_t file)
 {
   CloseHandle(file);
@@ -508,3 +565,18 @@ void sys_mutex_free(sys_mutex_t mtx)
   DeleteCriticalSection(mtx);
   wt_pool_free(&s->critical_section_pool, mtx);
 }
+
+i32 sys_atomic_add(volatile i32 *x, i32 value)
+{
+  return InterlockedExchangeAdd((volatile LONG*)x, value);
+}
+
+i32 sys_atomic_exchange(volatile i32 *x, i32 value)
+{
+  return InterlockedExchange((volatile LONG*)x, value);
+}
+
+i32 sys_atomic_compare_exchange(volatile i32 *x, i32 value, i32 comparand)
+{
+  return InterlockedCompareExchange((volatile LONG*)x, value, comparand);
+}
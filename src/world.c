@@ -5,14 +5,139 @@
 #include "job.h"
 #include "player.h"
 #include "system.h"
+#include "region.h"
+#include "codec.h"
+#include "journal.h"
+#include "light.h"
+#include "tick.h"
+#include "fluid.h"
+#include "rng.h"
 #include <zstd.h>
 #include <math.h>
+#include <stdlib.h>
+#include <string.h>
 
-#define WORLD_ZSTD_COMPRESS_LEVEL 3
+// compressed chunks that aren't resident live in here. once it fills up, the least recently used
+// ones get written out to their region files
+#define WORLD_STASH_SIZE WT_MEGABYTES(128)
 
+// caps on how much streaming work is in flight. loads are kept to a few per worker so the job queue
+// stays shallow and newly needed chunks near the player don't wait behind far away ones
+#define WORLD_LOADS_PER_WORKER 4
+#define WORLD_MAX_LOADS_IN_FLIGHT 128
+
+// world_save snapshots the world, then save jobs compress chunks into a fixed set of slots.
+// the main thread writes finished slots and stashed chunks out to their regions each tick
+#define WORLD_MAX_SAVES_IN_FLIGHT 32
+#define WORLD_SAVE_SLOT_SIZE ZSTD_COMPRESSBOUND(CHUNK_NUM_BLOCKS * sizeof(block_id_t))
+#define WORLD_MAX_SAVE_BYTES_PER_TICK WT_MEGABYTES(4)
+
+// edits read back from the journal are held until their chunks are loaded. once this many new edits
+// have gone into the journal, a save is started to fold them into the region files. there's room
+// for a few bulk edits worth, since one can journal hundreds of thousands of blocks before a save
+#define WORLD_MAX_PENDING_EDITS (1 << 20)
+#define WORLD_JOURNAL_COMPACT_RECORDS 16384
+
+#define WORLD_BENCHMARK_RAYS 65536
+#define WORLD_BENCHMARK_BOXES 65536
+#define WORLD_BENCHMARK_STEPS (1 << 22)
+
+#define WORLD_MAX_LOAD_OFFSETS ((2 * VIEW_DISTANCE + 1) * (2 * VIEW_DISTANCE + 1))
+
+#define WORLD_MAGIC 0x444c5257 // "WRLD"
+#define WORLD_VERSION 2 // 0: no header, every chunk was stored in the world file, 2: added seed
+
+// chunks themselves live in region files, each with its own chunk index and codec per chunk
+typedef struct
+{
+  u32 magic;
+  u32 version;
+  u32 size_x; // in chunks
+  u32 size_z;
+  u32 region_size;
+  u32 seed; // version 1 worlds read this as 0
+} world_header_t;
+
+#define WORLD_HEADER_V1_SIZE offsetof(world_header_t, seed)
+
+static const wt_vec2_t k_neighbors[] = { { -1, 0 }, { 1, 0 }, { 0, -1 }, { 0, 1 } };
+
+typedef struct
+{
+  void *data; // NULL if the chunk isn't stashed, it might still be in its region file
+  usize size;
+  codec_id_t codec;
+  u64 last_used_tick;
+  bool mapped; // data points into a mapped region file instead of the stash heap
+  bool save_pending; // the save in progress still has to write this out
+  bool modified; // differs from what's in the region file
+} world_stash_entry_t;
+
+// where a chunk is in an old single file world, size is 0 if it isn't
 typedef struct
 {
-  chunk_t *chunks[WORLD_MAX_CHUNKS];
+  usize offset;
+  usize size;
+} world_legacy_entry_t;
+
+typedef struct
+{
+  wt_vec2_t pos;
+  chunk_data_t *snapshot; // the blocks as they were when the save got to them
+  bool queued;
+  volatile i32 done;
+  void *data;
+  usize size; // 0 if there's nothing to write
+  codec_id_t codec;
+  bool baseline; // the chunk is back to how it was generated, it comes out of its region file
+} world_save_slot_t;
+
+typedef struct
+{
+  wt_vec2_t pos;
+  i32 radius;
+  bool active;
+} world_ticket_info_t;
+
+typedef struct
+{
+  wt_vec2_t size; // in chunks, indices are still laid out for the biggest world
+  u32 seed;
+  chunk_t *chunks[WORLD_MAX_CHUNKS]; // NULL if the chunk isn't resident
+
+  chunk_t *resident[CHUNK_MAX + 2];
+  usize num_resident;
+
+  world_ticket_info_t tickets[WORLD_MAX_TICKETS];
+  world_ticket_t player_ticket;
+  world_ticket_t spawn_ticket;
+  u64 tick;
+
+  wt_buddy_t stash_heap;
+  world_stash_entry_t stash[WORLD_MAX_CHUNKS];
+
+  world_save_slot_t save_slots[WORLD_MAX_SAVES_IN_FLIGHT];
+  volatile i32 save_jobs;
+  bool saving;
+
+  // old worlds are read a chunk at a time as they're needed, until a save moves whatever is left
+  // of them into region files and replaces them with a header
+  sys_file_t legacy_file;
+  world_legacy_entry_t legacy[WORLD_MAX_CHUNKS];
+
+  // edits from the journal that aren't in any region file yet, grouped by chunk in the order they
+  // were made. they're made again when their chunk is loaded
+  journal_record_t *pending_edits;
+  usize num_pending_edits;
+  u32 first_pending_edit[WORLD_MAX_CHUNKS];
+  u32 num_chunk_pending_edits[WORLD_MAX_CHUNKS];
+
+  usize journal_save_mark; // records in the journal when the save in progress started
+  usize journal_base; // records in the journal when it was last compacted
+
+  // offsets within the view distance, sorted nearest first
+  wt_vec2_t load_offsets[WORLD_MAX_LOAD_OFFSETS];
+  usize num_load_offsets;
 } world_state_t;
 
 world_state_t *get_state(void)
@@ -20,195 +145,1426 @@ world_state_t *get_state(void)
   return game_get_state()->modules.world;
 }
 
+static int compare_offsets(const void *a, const void *b)
+{
+  const wt_vec2_t *oa = a, *ob = b;
+  return (oa->x * oa->x + oa->y * oa->y) - (ob->x * ob->x + ob->y * ob->y);
+}
+
 void world_init(void)
 {
   game_state_t *gs = game_get_state();
   world_state_t *s = gs->modules.world = mem_hunk_push(sizeof(world_state_t));
 
+  s->size = wt_vec2(WORLD_MAX_CHUNKS_X, WORLD_MAX_CHUNKS_Z);
+  s->stash_heap = wt_buddy_new(mem_hunk_push(WORLD_STASH_SIZE), WORLD_STASH_SIZE);
+  s->pending_edits = mem_hunk_push(WORLD_MAX_PENDING_EDITS * sizeof(journal_record_t));
+
+  for (usize i = 0; i < WORLD_MAX_SAVES_IN_FLIGHT; ++i)
+  {
+    s->save_slots[i].data = mem_hunk_push(WORLD_SAVE_SLOT_SIZE);
+  }
+
+  for (i32 z = -VIEW_DISTANCE; z <= VIEW_DISTANCE; ++z)
+  {
+    for (i32 x = -VIEW_DISTANCE; x <= VIEW_DISTANCE; ++x)
+    {
+      if (x * x + z * z <= VIEW_DISTANCE * VIEW_DISTANCE)
+      {
+        s->load_offsets[s->num_load_offsets++] = wt_vec2(x, z);
+      }
+    }
+  }
+  qsort(s->load_offsets, s->num_load_offsets, sizeof(wt_vec2_t), compare_offsets);
+
+  // the player ticket gets moved along with the player every tick
+  s->player_ticket = world_ticket_add(world_get_spawn_chunk(), VIEW_DISTANCE);
+  s->spawn_ticket = world_ticket_add(world_get_spawn_chunk(), WORLD_SPAWN_RADIUS);
+}
+
+world_ticket_t world_ticket_add(wt_vec2_t chunk_pos, i32 radius)
+{
+  world_state_t *s = get_state();
+  WT_ASSERT(radius <= VIEW_DISTANCE);
+  for (world_ticket_t i = 0; i < WORLD_MAX_TICKETS; ++i)
+  {
+    if (!s->tickets[i].active)
+    {
+      s->tickets[i] = (world_ticket_info_t){ chunk_pos, radius, true };
+      return i;
+    }
+  }
+  WT_ASSERT(false && "out of tickets");
+  return -1;
+}
+
+void world_ticket_move(world_ticket_t ticket, wt_vec2_t chunk_pos)
+{
+  world_state_t *s = get_state();
+  if (ticket >= 0 && ticket < WORLD_MAX_TICKETS)
+  {
+    s->tickets[ticket].pos = chunk_pos;
+  }
+}
+
+void world_ticket_remove(world_ticket_t ticket)
+{
+  world_state_t *s = get_state();
+  if (ticket >= 0 && ticket < WORLD_MAX_TICKETS)
+  {
+    s->tickets[ticket].active = false;
+  }
+}
+
+static bool chunk_pos_within_bounds(wt_vec2_t pos)
+{
+  world_state_t *s = get_state();
+  return pos.x >= 0 && pos.y >= 0 && pos.x < s->size.x && pos.y < s->size.y;
+}
+
+chunk_t *world_get_chunk(wt_vec2_t pos)
+{
+  world_state_t *s = get_state();
+  if (chunk_pos_within_bounds(pos))
+  {
+    return s->chunks[pos.x + pos.y * WORLD_MAX_CHUNKS_X];
+  }
+  return NULL;
+}
+
+static bool chunk_ticketed(wt_vec2_t pos)
+{
+  world_state_t *s = get_state();
+  for (usize i = 0; i < WORLD_MAX_TICKETS; ++i)
+  {
+    world_ticket_info_t *t = &s->tickets[i];
+    wt_vec2_t d = wt_vec2i_sub(pos, t->pos);
+    if (t->active && d.x * d.x + d.y * d.y <= t->radius * t->radius)
+    {
+      return true;
+    }
+  }
+  return false;
+}
+
+usize world_get_ticking_chunks(chunk_t **chunks, usize max)
+{
+  world_state_t *s = get_state();
+  usize n = 0;
+  for (usize i = 0; i < s->num_resident && n < max; ++i)
+  {
+    chunk_t *c = s->resident[i];
+    if (c->status == CHUNK_STATUS_READY && chunk_ticketed(c->position))
+    {
+      chunks[n++] = c;
+    }
+  }
+  return n;
+}
+
+static wt_vec2_t chunk_pos_from_index(usize idx)
+{
+  return wt_vec2(idx % WORLD_MAX_CHUNKS_X, idx / WORLD_MAX_CHUNKS_X);
+}
+
+static void stash_write(usize idx)
+{
+  world_state_t *s = get_state();
+  world_stash_entry_t *e = &s->stash[idx];
+  region_write_chunk(chunk_pos_from_index(idx), e->data, e->size, e->codec);
+  e->save_pending = false;
+}
+
+static void stash_release(usize idx)
+{
+  world_state_t *s = get_state();
+  world_stash_entry_t *e = &s->stash[idx];
+  if (e->save_pending)
+  {
+    stash_write(idx);
+  }
+
+  if (e->mapped)
+  {
+    region_unpin_chunk(chunk_pos_from_index(idx));
+  }
+  else if (e->data)
+  {
+    wt_buddy_release(&s->stash_heap, e->data);
+  }
+  memset(e, 0, sizeof(*e));
+}
+
+// writes the least recently used stashed chunk to its region file to make room in the stash heap
+static bool stash_spill(void)
+{
+  world_state_t *s = get_state();
+
+  isize lru = -1;
+  for (usize i = 0; i < WORLD_MAX_CHUNKS; ++i)
+  {
+    // resident chunks only have a stash entry while a job is decompressing it
+    world_stash_entry_t *e = &s->stash[i];
+    if (e->data && !s->chunks[i] && (lru == -1 || e->last_used_tick < s->stash[lru].last_used_tick))
+    {
+      lru = i;
+    }
+  }
+
+  if (lru == -1)
+  {
+    return false;
+  }
+
+  // unmodified ones are in their region file already, or get written by the save in progress
+  world_stash_entry_t *e = &s->stash[lru];
+  if (e->modified && !region_write_chunk(chunk_pos_from_index(lru), e->data, e->size, e->codec))
+  {
+    return false;
+  }
+  stash_release(lru);
+  return true;
+}
+
+static bool stash_store(usize idx, void *data, usize size, codec_id_t codec, bool modified)
+{
+  world_state_t *s = get_state();
+  stash_release(idx);
+
+  world_stash_entry_t *e = &s->stash[idx];
+  e->data = wt_buddy_alloc(&s->stash_heap, size);
+  while (!e->data && stash_spill())
+  {
+    e->data = wt_buddy_alloc(&s->stash_heap, size);
+  }
+
+  if (e->data)
+  {
+    memcpy(e->data, data, size);
+    e->size = size;
+    e->codec = codec;
+    e->last_used_tick = s->tick;
+    e->modified = modified;
+    return true;
+  }
+  return false;
+}
+
+// reads a chunk out of an old world file into scratch memory. returns 0 if it isn't in there
+static usize legacy_read(usize idx, void **data)
+{
+  world_state_t *s = get_state();
+  world_legacy_entry_t *l = &s->legacy[idx];
+  if (l->size == 0)
+  {
+    return 0;
+  }
+
+  *data = mem_scratch_push(l->size);
+  if (!sys_file_seek(s->legacy_file, l->offset) || !sys_file_read(s->legacy_file, *data, l->size))
+  {
+    return 0;
+  }
+  return l->size;
+}
+
+// old worlds had no header, the file was repeated for every chunk in the world:
+//   position, compressed size, zstd payload
+// it's only walked to find where each chunk is, anything past the end of the file or outside the
+// biggest world is ignored. the world is as big as the furthest chunk in it
+static bool open_legacy_world(sys_file_t file)
+{
+  world_state_t *s = get_state();
+  usize file_size = sys_file_get_size(file);
+  wt_vec2_t size = { 0 };
+
+  usize offset = 0;
+  while (offset + sizeof(wt_vec2_t) + sizeof(usize) <= file_size)
+  {
+    wt_vec2_t pos = { 0 };
+    usize cmp_size = 0;
+    if (!sys_file_seek(file, offset) || !sys_file_read(file, &pos, sizeof(pos)) ||
+      !sys_file_read(file, &cmp_size, sizeof(cmp_size)))
+    {
+      break;
+    }
+    offset += sizeof(pos) + sizeof(cmp_size);
+    if (cmp_size > file_size - offset)
+    {
+      break;
+    }
+
+    if (cmp_size > 0 && pos.x >= 0 && pos.y >= 0 && pos.x < WORLD_MAX_CHUNKS_X &&
+      pos.y < WORLD_MAX_CHUNKS_Z)
+    {
+      s->legacy[pos.x + pos.y * WORLD_MAX_CHUNKS_X] = (world_legacy_entry_t){ offset, cmp_size };
+      size.x = WT_MAX(size.x, pos.x + 1);
+      size.y = WT_MAX(size.y, pos.y + 1);
+    }
+    offset += cmp_size;
+  }
+
+  if (size.x == 0)
+  {
+    return false;
+  }
+  s->legacy_file = file;
+  s->size = size;
+  return true;
+}
+
+static void close_legacy_world(void)
+{
+  world_state_t *s = get_state();
+  if (s->legacy_file)
+  {
+    sys_file_close(s->legacy_file);
+    s->legacy_file = NULL;
+  }
+  memset(s->legacy, 0, sizeof(s->legacy));
+}
+
+// only once every chunk of an old world is in a region file
+static void write_header(void)
+{
+  world_state_t *s = get_state();
+  for (usize i = 0; s->legacy_file && i < WORLD_MAX_CHUNKS; ++i)
+  {
+    if (s->legacy[i].size > 0)
+    {
+      return;
+    }
+  }
+  close_legacy_world();
+
+  world_header_t header = { 0 };
+  header.magic = WORLD_MAGIC;
+  header.version = WORLD_VERSION;
+  header.size_x = s->size.x;
+  header.size_z = s->size.y;
+  header.region_size = REGION_SIZE;
+  header.seed = s->seed;
+
+  sys_file_t file = sys_file_open(WORLD_FILENAME, SYS_FILE_WRITE);
+  if (file)
+  {
+    sys_file_write(file, &header, sizeof(header));
+    sys_file_close(file);
+  }
+}
+
+// makes sure a compressed chunk that's only in its region file, or an old world file, is in the
+// stash heap. region files come first, they're newer
+static void stash_fetch(usize idx)
+{
+  world_state_t *s = get_state();
+  if (!s->stash[idx].data)
+  {
+    mem_scratch_begin();
+    void *data = NULL;
+    usize size = 0;
+    codec_id_t codec = CODEC_ZSTD;
+    if (region_read_chunk(chunk_pos_from_index(idx), &data, &size, &codec))
+    {
+      stash_store(idx, data, size, codec, false);
+    }
+    else if ((size = legacy_read(idx, &data)) > 0 && stash_store(idx, data, size, CODEC_ZSTD, true))
+    {
+      // it's not in any region file until the next save
+      s->legacy[idx].size = 0;
+    }
+    mem_scratch_end();
+  }
+}
+
+// compresses the chunk's blocks into scratch memory, returns the compressed size
+static usize compress_chunk(chunk_t *c, codec_profile_t profile, void **out, codec_id_t *codec)
+{
+  usize cmp_buf_size = ZSTD_compressBound(sizeof(c->data->blocks));
+  *out = mem_scratch_push(cmp_buf_size);
+  return codec_compress(profile, *out, cmp_buf_size, c->data->blocks, sizeof(c->data->blocks), codec);
+}
+
+// chunks that were changed and then changed back aren't worth storing either
+static bool chunk_is_baseline(wt_vec2_t pos, chunk_data_t *data)
+{
+  world_state_t *s = get_state();
+  mem_scratch_begin();
+  block_id_t *blocks = mem_scratch_push(sizeof(data->blocks));
+  chunk_gen_blocks(pos, s->seed, blocks);
+  bool res = memcmp(blocks, data->blocks, sizeof(data->blocks)) == 0;
+  mem_scratch_end();
+  return res;
+}
+
+// edits journaled for the chunk before it was loaded go in before it's lit. the main thread leaves
+// them alone until the chunk is ready, and journals them again then
+static bool apply_pending_edits(chunk_t *c)
+{
+  world_state_t *s = get_state();
+  usize idx = c->position.x + c->position.y * WORLD_MAX_CHUNKS_X;
+  journal_record_t *edits = s->pending_edits + s->first_pending_edit[idx];
+
+  for (u32 i = 0; i < s->num_chunk_pending_edits[idx]; ++i)
+  {
+    wt_vec3_t pos = journal_record_pos(&edits[i]);
+    pos = wt_vec3(pos.x % CHUNK_SIZE_X, pos.y, pos.z % CHUNK_SIZE_Z);
+    c->data->blocks[pos.x + pos.z * CHUNK_SIZE_X + pos.y * CHUNK_SIZE_X * CHUNK_SIZE_Z] =
+      edits[i].new_block;
+  }
+  return s->num_chunk_pending_edits[idx] > 0;
+}
+
+static void chunk_gen_job(void *param)
+{
+  chunk_t *chunk = (chunk_t*)param;
+  chunk_gen(chunk, get_state()->seed);
+  if (apply_pending_edits(chunk))
+  {
+    chunk_compute_heights(chunk->data);
+  }
+  light_compute_chunk(chunk->data);
+  fluid_scan_chunk(chunk);
+}
+
+static void chunk_decompress_job(void *param)
+{
+  chunk_t *c = (chunk_t*)param;
+  world_state_t *s = get_state();
+
+  // the main thread won't touch this entry until the chunk stops loading
+  world_stash_entry_t *e = &s->stash[c->position.x + c->position.y * WORLD_MAX_CHUNKS_X];
+  usize size = codec_decompress(e->codec, c->data->blocks, sizeof(c->data->blocks), e->data,
+    e->size);
+
+  // a corrupt chunk is lost, but it's better than garbage blocks. the main thread reports it
+  c->load_failed = size != sizeof(c->data->blocks);
+  if (c->load_failed)
+  {
+    chunk_gen_blocks(c->position, s->seed, c->data->blocks);
+  }
+  apply_pending_edits(c);
+  chunk_compute_heights(c->data);
+  light_compute_chunk(c->data);
+  fluid_scan_chunk(c);
+  c->dirty_sections = CHUNK_ALL_SECTIONS;
+}
+
+// works on a snapshot, the chunk can be written to or even evicted in the meantime
+static void chunk_save_job(void *param)
+{
+  world_save_slot_t *slot = (world_save_slot_t*)param;
+  chunk_data_t *data = slot->snapshot;
+
+  slot->baseline = chunk_is_baseline(slot->pos, data);
+  if (!slot->baseline)
+  {
+    slot->size = codec_compress(CODEC_PROFILE_SAVE, slot->data, WORLD_SAVE_SLOT_SIZE, data->blocks,
+      sizeof(data->blocks), &slot->codec);
+  }
+
+  chunk_release(data);
+  sys_atomic_exchange(&slot->done, 1);
+}
+
+static void queue_chunk_load(chunk_t *c)
+{
+  world_state_t *s = get_state();
+  usize idx = c->position.x + c->position.y * WORLD_MAX_CHUNKS_X;
+
+  c->status = CHUNK_STATUS_LOADING;
+  c->last_used_tick = s->tick;
+
+  // the decompression job reads straight out of the mapped region file, or the stash heap if the
+  // chunk hasn't been saved since it was evicted
+  world_stash_entry_t *e = &s->stash[idx];
+  const void *mapped_data = NULL;
+  if (!e->data && region_map_chunk(c->position, &mapped_data, &e->size, &e->codec))
+  {
+    e->data = (void*)mapped_data;
+    e->mapped = true;
+  }
+  stash_fetch(idx);
+
+  // generated chunks only need saving once they're changed, until then they can be generated again
+  c->modified = e->data && e->modified;
+
+  // the job writes every block, jobs still holding a snapshot of the old ones keep theirs. that's
+  // only ever world_generate, which has waited for every job first, so there's no copy to fail
+  bool unshared = chunk_unshare(c, false);
+  WT_ASSERT(unshared);
+  WT_UNUSED(unshared);
+
+  if (e->data)
+  {
+    job_queue_counted(chunk_decompress_job, c, &c->num_jobs);
+  }
+  else
+  {
+    job_queue_counted(chunk_gen_job, c, &c->num_jobs);
+  }
+}
+
+// mesh jobs for neighboring chunks hold snapshots of the blocks they read, so those don't count
+static bool chunk_in_use(chunk_t *c)
+{
+  // dirty chunks have edits that haven't been meshed yet
+  return c->num_jobs > 0 || c->status != CHUNK_STATUS_READY || c->dirty_sections ||
+    c->save_state != CHUNK_SAVE_NONE;
+}
+
+// returns false if the chunk couldn't be stashed, in which case it stays loaded
+static bool evict_chunk(usize resident_idx)
+{
+  world_state_t *s = get_state();
+  chunk_t *c = s->resident[resident_idx];
+  usize idx = c->position.x + c->position.y * WORLD_MAX_CHUNKS_X;
+
+  // unmodified chunks can be read back from their region file
+  bool stashed = !c->modified;
+  if (c->modified)
+  {
+    mem_scratch_begin();
+    void *cmp_buf = NULL;
+    codec_id_t codec = CODEC_ZSTD;
+    usize cmp_size = compress_chunk(c, CODEC_PROFILE_STASH, &cmp_buf, &codec);
+    stashed = cmp_size > 0 && stash_store(idx, cmp_buf, cmp_size, codec, true);
+    mem_scratch_end();
+  }
+
+  if (stashed)
+  {
+    s->stash[idx].last_used_tick = c->last_used_tick;
+    s->chunks[idx] = NULL;
+    s->resident[resident_idx] = s->resident[--s->num_resident];
+    chunk_free(c);
+  }
+  return stashed;
+}
+
+// frees up room for one more chunk by evicting the least recently used chunk that no ticket needs
+static bool evict_lru_chunk(void)
+{
+  world_state_t *s = get_state();
+
+  isize lru = -1;
+  for (usize i = 0; i < s->num_resident; ++i)
+  {
+    chunk_t *c = s->resident[i];
+    if (c->last_used_tick < s->tick && !chunk_in_use(c) &&
+      (lru == -1 || c->last_used_tick < s->resident[lru]->last_used_tick))
+    {
+      lru = i;
+    }
+  }
+  return lru != -1 && evict_chunk(lru);
+}
+
+static chunk_t *new_resident_chunk(wt_vec2_t pos)
+{
+  world_state_t *s = get_state();
+
+  chunk_t *c = NULL;
+  if (s->num_resident < CHUNK_MAX)
+  {
+    c = chunk_new(pos);
+  }
+  if (!c && evict_lru_chunk())
+  {
+    c = chunk_new(pos);
+  }
+
+  if (c)
+  {
+    s->chunks[pos.x + pos.y * WORLD_MAX_CHUNKS_X] = c;
+    s->resident[s->num_resident++] = c;
+  }
+  return c;
+}
+
+// edits that were journaled but never saved, in chunks that weren't loaded yet
+static void load_journal(void)
+{
+  world_state_t *s = get_state();
+  s->num_pending_edits = 0;
+  memset(s->num_chunk_pending_edits, 0, sizeof(s->num_chunk_pending_edits));
+
+  mem_scratch_begin();
+  journal_record_t *records = NULL;
+  usize num_records = journal_read(&records);
+  s->journal_base = num_records;
+
+  // bucket them by chunk, keeping them in order within each chunk
+  usize num_used = 0;
+  for (usize i = 0; i < num_records; ++i)
+  {
+    wt_vec3_t pos = journal_record_pos(&records[i]);
+    wt_vec2_t chunk_pos = wt_vec2(pos.x / CHUNK_SIZE_X, pos.z / CHUNK_SIZE_Z);
+    if (chunk_pos_within_bounds(chunk_pos))
+    {
+      if (s->num_pending_edits == WORLD_MAX_PENDING_EDITS)
+      {
+        WT_ASSERT(false && "too many edits in the journal");
+        break;
+      }
+      s->num_chunk_pending_edits[chunk_pos.x + chunk_pos.y * WORLD_MAX_CHUNKS_X] += 1;
+      s->num_pending_edits += 1;
+    }
+    num_used = i + 1;
+  }
+
+  u32 first = 0;
+  for (usize i = 0; i < WORLD_MAX_CHUNKS; ++i)
+  {
+    s->first_pending_edit[i] = first;
+    first += s->num_chunk_pending_edits[i];
+  }
+
+  u32 *cursors = mem_scratch_push(WORLD_MAX_CHUNKS * sizeof(u32));
+  memcpy(cursors, s->first_pending_edit, WORLD_MAX_CHUNKS * sizeof(u32));
+  for (usize i = 0; i < num_used; ++i)
+  {
+    wt_vec3_t pos = journal_record_pos(&records[i]);
+    wt_vec2_t chunk_pos = wt_vec2(pos.x / CHUNK_SIZE_X, pos.z / CHUNK_SIZE_Z);
+    if (chunk_pos_within_bounds(chunk_pos))
+    {
+      s->pending_edits[cursors[chunk_pos.x + chunk_pos.y * WORLD_MAX_CHUNKS_X]++] = records[i];
+    }
+  }
+  mem_scratch_end();
+}
+
+// the load job put the edits in, they go back into the journal since the chunk isn't saved with
+// them yet
+static void journal_pending_edits(chunk_t *c)
+{
+  world_state_t *s = get_state();
+  usize idx = c->position.x + c->position.y * WORLD_MAX_CHUNKS_X;
+  journal_record_t *edits = s->pending_edits + s->first_pending_edit[idx];
+
+  for (u32 i = 0; i < s->num_chunk_pending_edits[idx]; ++i)
+  {
+    journal_append(journal_record_pos(&edits[i]), edits[i].old_block, edits[i].new_block);
+  }
+
+  if (s->num_chunk_pending_edits[idx] > 0)
+  {
+    c->modified = true;
+  }
+  s->num_chunk_pending_edits[idx] = 0;
+}
+
+// once a save is done, everything journaled before it started is in the region files, except for
+// edits to chunks that still haven't been loaded. those and whatever came after the save stay
+static void compact_journal(void)
+{
+  world_state_t *s = get_state();
+  journal_commit();
+
+  mem_scratch_begin();
+  journal_record_t *records = NULL;
+  usize num_records = journal_read(&records);
+  usize mark = WT_MIN(s->journal_save_mark, num_records);
+
+  journal_record_t *keep = mem_scratch_push((s->num_pending_edits + num_records - mark) *
+    sizeof(journal_record_t));
+  usize num_keep = 0;
+  for (usize i = 0; i < WORLD_MAX_CHUNKS; ++i)
+  {
+    memcpy(keep + num_keep, s->pending_edits + s->first_pending_edit[i],
+      s->num_chunk_pending_edits[i] * sizeof(journal_record_t));
+    num_keep += s->num_chunk_pending_edits[i];
+  }
+  memcpy(keep + num_keep, records + mark, (num_records - mark) * sizeof(journal_record_t));
+  num_keep += num_records - mark;
+
+  if (num_keep < num_records)
+  {
+    journal_rewrite(keep, num_keep);
+  }
+  s->journal_base = num_keep;
+  s->journal_save_mark = 0;
+  mem_scratch_end();
+}
+
+static void stream_chunks(void)
+{
+  world_state_t *s = get_state();
+  s->tick += 1;
+
+  wt_vec3f_t player_pos = player_get_position();
+  world_ticket_move(s->player_ticket,
+    wt_vec2(floorf(player_pos.x / CHUNK_SIZE_X), floorf(player_pos.z / CHUNK_SIZE_Z)));
+
+  // finish loading chunks whose jobs are done, and keep ticketed chunks fresh
+  usize num_in_flight = 0;
+  for (usize i = 0; i < s->num_resident; ++i)
+  {
+    chunk_t *c = s->resident[i];
+    if (c->status == CHUNK_STATUS_LOADING && c->num_jobs > 0)
+    {
+      num_in_flight += 1;
+    }
+    else if (c->status == CHUNK_STATUS_LOADING)
+    {
+      c->status = CHUNK_STATUS_READY;
+      stash_release(c->position.x + c->position.y * WORLD_MAX_CHUNKS_X);
+      if (c->load_failed)
+      {
+        // saving it again replaces what's stored
+        game_dbg_print("chunk (%d %d) didn't decompress, generated it again", c->position.x,
+          c->position.y);
+        c->modified = true;
+      }
+      journal_pending_edits(c);
+      light_stitch_chunk(c);
+      fluid_chunk_ready(c);
+
+      // neighbors were meshed without this chunk, so their border faces need culling again
+      for (usize j = 0; j < WT_ARRAY_COUNT(k_neighbors); ++j)
+      {
+        chunk_t *n = world_get_chunk(wt_vec2i_add(c->position, k_neighbors[j]));
+        if (n && n->status == CHUNK_STATUS_READY)
+        {
+          n->dirty_sections = CHUNK_ALL_SECTIONS;
+        }
+      }
+    }
+
+    if (chunk_ticketed(c->position))
+    {
+      c->last_used_tick = s->tick;
+    }
+  }
+
+  usize max_in_flight = WT_MAX(job_get_num_workers(), 1) * WORLD_LOADS_PER_WORKER;
+  max_in_flight = WT_MIN(max_in_flight, WORLD_MAX_LOADS_IN_FLIGHT);
+
+  // pick the closest missing chunks for each ticket, the player's ticket comes first
+  chunk_t *loads[WORLD_MAX_LOADS_IN_FLIGHT];
+  usize num_loads = 0;
+  bool over_budget = false;
+  for (usize t = 0; t < WORLD_MAX_TICKETS && !over_budget; ++t)
+  {
+    world_ticket_info_t *ticket = &s->tickets[t];
+    if (!ticket->active)
+    {
+      continue;
+    }
+
+    for (usize i = 0; i < s->num_load_offsets && num_in_flight + num_loads < max_in_flight; ++i)
+    {
+      wt_vec2_t offset = s->load_offsets[i];
+      if (offset.x * offset.x + offset.y * offset.y > ticket->radius * ticket->radius)
+      {
+        break; // offsets are sorted by distance, so the rest are outside the ticket too
+      }
+
+      wt_vec2_t pos = wt_vec2i_add(ticket->pos, offset);
+      if (!chunk_pos_within_bounds(pos) || world_get_chunk(pos))
+      {
+        continue;
+      }
+
+      chunk_t *c = new_resident_chunk(pos);
+      if (!c)
+      {
+        over_budget = true; // nothing can be evicted right now
+        break;
+      }
+      loads[num_loads++] = c;
+    }
+  }
+
+  // the job queue is LIFO, so queue the farthest first to have the nearest picked up first
+  for (usize i = num_loads; i > 0; --i)
+  {
+    queue_chunk_load(loads[i - 1]);
+  }
+}
+
+// writes out what the save jobs have finished and hands free slots the next chunks
+static void continue_save(void)
+{
+  world_state_t *s = get_state();
+  if (!s->saving)
+  {
+    return;
+  }
+
+  bool busy = false;
+  usize next_resident = 0;
+  for (usize i = 0; i < WORLD_MAX_SAVES_IN_FLIGHT; ++i)
+  {
+    world_save_slot_t *slot = &s->save_slots[i];
+    if (slot->queued && slot->done)
+    {
+      if (slot->size > 0)
+      {
+        region_write_chunk(slot->pos, slot->data, slot->size, slot->codec);
+      }
+      else if (slot->baseline)
+      {
+        region_remove_chunk(slot->pos);
+      }
+      slot->queued = false;
+    }
+
+    for (; !slot->queued && next_resident < s->num_resident; ++next_resident)
+    {
+      chunk_t *c = s->resident[next_resident];
+      if (c->save_state == CHUNK_SAVE_PENDING)
+      {
+        c->save_state = CHUNK_SAVE_NONE;
+        slot->pos = c->position;
+        slot->snapshot = chunk_snapshot(c);
+        slot->queued = true;
+        slot->done = 0;
+        slot->size = 0;
+        slot->baseline = false;
+        job_queue_counted(chunk_save_job, slot, &s->save_jobs);
+      }
+    }
+
+    busy = busy || slot->queued;
+  }
+
+  // stashed chunks are compressed already, they only need writing
+  usize num_bytes = 0;
   for (usize i = 0; i < WORLD_MAX_CHUNKS; ++i)
   {
-    s->chunks[i] = chunk_new(wt_vec2(i % WORLD_MAX_CHUNKS_X, i / WORLD_MAX_CHUNKS_X));
+    if (s->stash[i].save_pending)
+    {
+      if (num_bytes >= WORLD_MAX_SAVE_BYTES_PER_TICK)
+      {
+        busy = true;
+        break;
+      }
+      num_bytes += s->stash[i].size;
+      stash_write(i);
+    }
+  }
+
+  // so are chunks from an old world that were never loaded
+  for (usize i = 0; s->legacy_file && i < WORLD_MAX_CHUNKS; ++i)
+  {
+    if (s->legacy[i].size > 0)
+    {
+      if (num_bytes >= WORLD_MAX_SAVE_BYTES_PER_TICK)
+      {
+        busy = true;
+        break;
+      }
+
+      wt_vec2_t pos = chunk_pos_from_index(i);
+      mem_scratch_begin();
+      void *data = NULL;
+      usize size = legacy_read(i, &data);
+      if (size > 0 && !region_has_chunk(pos))
+      {
+        region_write_chunk(pos, data, size, CODEC_ZSTD);
+      }
+      mem_scratch_end();
+      num_bytes += size;
+      s->legacy[i].size = 0;
+    }
+  }
+
+  s->saving = busy;
+  if (!s->saving)
+  {
+    write_header();
+    compact_journal();
+  }
+}
+
+// world_save promised the blocks as they were when it was called, so they're written out before
+// they change. chunks a save job has been queued for already are fine, it has a snapshot
+static void flush_chunk_save(chunk_t *c)
+{
+  if (c->save_state == CHUNK_SAVE_PENDING)
+  {
+    mem_scratch_begin();
+    void *cmp_buf = NULL;
+    codec_id_t codec = CODEC_ZSTD;
+    if (chunk_is_baseline(c->position, c->data))
+    {
+      region_remove_chunk(c->position);
+    }
+    else
+    {
+      usize cmp_size = compress_chunk(c, CODEC_PROFILE_SAVE, &cmp_buf, &codec);
+      if (cmp_size > 0)
+      {
+        region_write_chunk(c->position, cmp_buf, cmp_size, codec);
+      }
+    }
+    mem_scratch_end();
+    c->save_state = CHUNK_SAVE_NONE;
+  }
+}
+
+void world_tick(void)
+{
+  world_state_t *s = get_state();
+
+  // blocks tick at their own fixed rate, their edits go into this tick's journal write
+  tick_update(game_get_state()->delta_time);
+
+  // everything edited since the last tick goes into the journal in one write
+  journal_commit();
+  if (!s->saving && journal_get_num_records() - s->journal_base >= WORLD_JOURNAL_COMPACT_RECORDS)
+  {
+    world_save();
+  }
+
+  continue_save();
+  stream_chunks();
+}
+
+void world_render(void)
+{
+  world_state_t *s = get_state();
+  wt_vec2_t center = s->tickets[s->player_ticket].pos;
+
+  // light from this tick's edits and newly loaded chunks, before anything gets meshed with it
+  light_update();
+
+  // cached chunks outside the view distance stay resident, but aren't drawn
+  for (usize i = 0; i < s->num_resident; ++i)
+  {
+    chunk_t *c = s->resident[i];
+    wt_vec2_t d = wt_vec2i_sub(c->position, center);
+    if (c->status == CHUNK_STATUS_READY && d.x * d.x + d.y * d.y <= VIEW_DISTANCE * VIEW_DISTANCE)
+    {
+      chunk_render(c);
+    }
   }
 }
 
-void world_tick(void)
+void world_generate(u32 seed)
 {
   world_state_t *s = get_state();
-  // todo: do something
-  WT_UNUSED(s);
+  world_save_wait();
+
+  // chunks still being generated would come out of the old seed
+  for (usize i = 0; i < s->num_resident; ++i)
+  {
+    job_wait(&s->resident[i]->num_jobs);
+  }
+
+  // throw away everything that was saved, then regenerate whatever is loaded right now
+  close_legacy_world();
+  s->seed = seed;
+  write_header();
+  memset(s->num_chunk_pending_edits, 0, sizeof(s->num_chunk_pending_edits));
+  journal_rewrite(NULL, 0);
+  s->journal_base = 0;
+  for (usize i = 0; i < WORLD_MAX_CHUNKS; ++i)
+  {
+    stash_release(i);
+    region_remove_chunk(chunk_pos_from_index(i));
+  }
+
+  for (usize i = 0; i < s->num_resident; ++i)
+  {
+    queue_chunk_load(s->resident[i]);
+  }
 }
 
-void world_render(void)
+// only chunks modified since the last save get written, everything else is in its region file
+// already. this only marks them, the actual work is spread over the next ticks
+void world_save(void)
 {
   world_state_t *s = get_state();
+
+  // the save in progress is older, it can't land on top of this one
+  world_save_wait();
+
+  journal_commit();
+  s->journal_save_mark = journal_get_num_records();
+
+  for (usize i = 0; i < s->num_resident; ++i)
+  {
+    chunk_t *c = s->resident[i];
+    if (c->status == CHUNK_STATUS_READY && c->modified)
+    {
+      c->save_state = CHUNK_SAVE_PENDING;
+      c->modified = false;
+    }
+  }
+
   for (usize i = 0; i < WORLD_MAX_CHUNKS; ++i)
   {
-    chunk_render(s->chunks[i]);
+    if (s->stash[i].modified)
+    {
+      s->stash[i].save_pending = true;
+      s->stash[i].modified = false;
+    }
   }
-}
 
-static void chunk_gen_job(void *param)
-{
-  chunk_t *chunk = (chunk_t*)param;
-  chunk_gen(chunk);
+  s->saving = true;
 }
 
-void world_generate(void)
+void world_save_wait(void)
 {
   world_state_t *s = get_state();
-  for (usize i = 0; i < WORLD_MAX_CHUNKS; ++i)
+  continue_save();
+  while (s->saving)
   {
-    job_queue(chunk_gen_job, s->chunks[i]);
+    job_wait(&s->save_jobs);
+    continue_save();
   }
 }
 
-#define WORLD_FILENAME "test.world"
-
-void world_save(void)
+// chunks are read lazily from their region files as they're streamed in, so this only reads the
+// header. returns false if there's no world to load, or it can't be read
+bool world_load(void)
 {
-  mem_scratch_begin();
-
   world_state_t *s = get_state();
-  sys_file_t file = sys_file_open(WORLD_FILENAME, SYS_FILE_WRITE);
+  close_legacy_world();
+  s->size = wt_vec2(WORLD_MAX_CHUNKS_X, WORLD_MAX_CHUNKS_Z);
+  s->seed = WORLD_DEFAULT_SEED;
+
+  bool res = false;
+  bool bad_header = false;
+  sys_file_t file = sys_file_open(WORLD_FILENAME, SYS_FILE_READ);
   if (file)
   {
-    for (usize i = 0; i < WORLD_MAX_CHUNKS; ++i)
+    world_header_t header = { 0 };
+    usize header_size = WT_MIN(sys_file_get_size(file), sizeof(header));
+    if (header_size >= WORLD_HEADER_V1_SIZE && sys_file_read(file, &header, header_size) &&
+      header.magic == WORLD_MAGIC)
     {
-      chunk_t *c = s->chunks[i];
-      sys_file_write(file, &c->position, sizeof(c->position));
-
-      usize cmp_buf_size = ZSTD_compressBound(sizeof(c->blocks));
-      void *cmp_buf = mem_scratch_push(cmp_buf_size);
-      usize cmp_size = ZSTD_compress(cmp_buf, cmp_buf_size, c->blocks, sizeof(c->blocks),
-        WORLD_ZSTD_COMPRESS_LEVEL);
-
-      sys_file_write(file, &cmp_size, sizeof(cmp_size));
-      sys_file_write(file, cmp_buf, cmp_size);
+      res = header.version <= WORLD_VERSION && header.region_size == REGION_SIZE &&
+        header.size_x > 0 && header.size_x <= WORLD_MAX_CHUNKS_X &&
+        header.size_z > 0 && header.size_z <= WORLD_MAX_CHUNKS_Z;
+      if (res)
+      {
+        s->size = wt_vec2(header.size_x, header.size_z);
+        s->seed = header.seed;
+      }
+      else
+      {
+        game_dbg_print("%s has a header this version can't read (version %u, %ux%u chunks)",
+          WORLD_FILENAME, header.version, header.size_x, header.size_z);
+        bad_header = true;
+      }
+      sys_file_close(file);
+    }
+    else if (open_legacy_world(file))
+    {
+      res = true; // the file stays open until it's been moved into region files
+    }
+    else
+    {
+      sys_file_close(file);
     }
-    sys_file_close(file);
   }
 
-  mem_scratch_end();
+  // worlds saved before there was a header are the biggest size. a world that was never saved is
+  // only in the journal. with a bad header its region files can't be trusted to be either
+  load_journal();
+  res = res || (!bad_header && (region_exists(world_get_spawn_chunk()) || s->num_pending_edits));
+
+  world_ticket_move(s->spawn_ticket, world_get_spawn_chunk());
+  world_ticket_move(s->player_ticket, world_get_spawn_chunk());
+  return res;
 }
 
-bool world_load(void)
+wt_vec2_t world_get_size(void)
+{
+  return get_state()->size;
+}
+
+u32 world_get_seed(void)
+{
+  return get_state()->seed;
+}
+
+wt_vec2_t world_get_spawn_chunk(void)
 {
-  mem_scratch_begin();
   world_state_t *s = get_state();
-  sys_file_t file = sys_file_open(WORLD_FILENAME, SYS_FILE_READ);
-  if (file)
+  return wt_vec2(s->size.x - 1, s->size.y - 1);
+}
+
+void world_dbg_rebuild_meshes(void)
+{
+  world_state_t *s = get_state();
+  for (usize i = 0; i < s->num_resident; ++i)
   {
-    for (usize i = 0; i < WORLD_MAX_CHUNKS; ++i)
+    chunk_t *c = s->resident[i];
+    if (c->status == CHUNK_STATUS_READY)
     {
-      chunk_t *c = s->chunks[i];
-      sys_file_read(file, &c->position, sizeof(c->position));
-
-      usize cmp_size = 0;
-      sys_file_read(file, &cmp_size, sizeof(cmp_size));
-      void *cmp_buf = mem_scratch_push(cmp_size);
-      sys_file_read(file, cmp_buf, cmp_size);
-
-      ZSTD_decompress(c->blocks, sizeof(c->blocks), cmp_buf, cmp_size);
+      c->dirty_sections = CHUNK_ALL_SECTIONS;
     }
-    sys_file_close(file);
-    world_dbg_rebuild_meshes();
-    mem_scratch_end();
-    return true;
   }
-  mem_scratch_end();
-  return false;
 }
 
-void world_dbg_rebuild_meshes(void)
+static void mark_chunk_dirty(wt_vec2_t chunk_pos, u32 sections)
 {
-  world_state_t *s = get_state();
-  for (u32 i = 0; i < WT_ARRAY_COUNT(s->chunks); ++i)
+  chunk_t *c = world_get_chunk(chunk_pos);
+  if (c)
   {
-    chunk_rebuild_mesh(s->chunks[i]);
+    c->dirty_sections |= sections;
   }
 }
 
 void world_set_block(wt_vec3_t pos, block_id_t block)
 {
-  world_state_t *s = get_state();
-
   wt_vec2_t chunk_pos = { 0 };
   chunk_pos.x = floorf(pos.x / CHUNK_SIZE_X);
   chunk_pos.y = floorf(pos.z / CHUNK_SIZE_Z);
-  if (chunk_pos.x >= 0 && chunk_pos.y >= 0 &&
-    chunk_pos.x < WORLD_MAX_CHUNKS_X && chunk_pos.y < WORLD_MAX_CHUNKS_Z)
-  {
-    chunk_t *c = s->chunks[chunk_pos.x + chunk_pos.y * WORLD_MAX_CHUNKS_X];
 
+  // blocks in chunks that aren't loaded are dropped, a chunk's load job is still writing its blocks
+  // until it's ready
+  chunk_t *c = world_get_chunk(chunk_pos);
+  if (c && c->status == CHUNK_STATUS_READY)
+  {
     wt_vec3_t block_pos = { 0 };
     block_pos.x = pos.x % CHUNK_SIZE_X;
     block_pos.y = pos.y;
     block_pos.z = pos.z % CHUNK_SIZE_Z;
 
-    chunk_set_block(c, block_pos, block);
+    // so are edits to chunks that jobs are holding every old version of
+    block_id_t old_block = chunk_get_block(c, block_pos);
+    flush_chunk_save(c);
+    if (!chunk_set_block(c, block_pos, block))
+    {
+      return;
+    }
+    if (block != old_block)
+    {
+      journal_append(pos, old_block, block);
+      light_block_changed(pos);
+      tick_block_changed(pos, old_block, block);
+      fluid_block_changed(pos, old_block, block);
+    }
 
-    // if we're breaking a block at the edge of a chunk, we need to update the neighboring chunk
-    if (block == 0)
+    // if we're changing a block at the edge of a chunk, we need to update the neighboring chunk.
+    // only the section next to it sees the change
+    if (block != old_block)
     {
-      if (block_pos.x == 0 && chunk_pos.x > 0)
-      {
-        s->chunks[(chunk_pos.x - 1) + chunk_pos.y * WORLD_MAX_CHUNKS_X]->dirty = true;
-      }
-      if (block_pos.x == CHUNK_SIZE_X - 1 && chunk_pos.x < WORLD_MAX_CHUNKS_X - 1)
-      {
-        s->chunks[(chunk_pos.x + 1) + chunk_pos.y * WORLD_MAX_CHUNKS_X]->dirty = true;
-      }
-      if (block_pos.z == 0 && chunk_pos.y > 0)
+      u32 section = 1u << (block_pos.y / CHUNK_SECTION_SIZE_Y);
+      if (block_pos.x == 0)                { mark_chunk_dirty(wt_vec2(chunk_pos.x - 1, chunk_pos.y), section); }
+      if (block_pos.x == CHUNK_SIZE_X - 1) { mark_chunk_dirty(wt_vec2(chunk_pos.x + 1, chunk_pos.y), section); }
+      if (block_pos.z == 0)                { mark_chunk_dirty(wt_vec2(chunk_pos.x, chunk_pos.y - 1), section); }
+      if (block_pos.z == CHUNK_SIZE_Z - 1) { mark_chunk_dirty(wt_vec2(chunk_pos.x, chunk_pos.y + 1), section); }
+    }
+  }
+}
+
+// a bulk edit writes straight into a chunk's blocks. the chunk is only flushed, unshared and marked
+// changed on its first changed block
+typedef struct
+{
+  chunk_t *c;
+  wt_vec3_t origin; // of the chunk in the world
+  block_id_t *blocks; // NULL until something changes
+  bool failed; // the chunk couldn't be unshared, the rest of the edit is dropped
+  u32 sections; // of the chunk that need remeshing
+  u32 side_sections[4]; // of each neighbor that see a changed block, in k_neighbors order
+} bulk_edit_t;
+
+static bool begin_bulk_edit(bulk_edit_t *e, wt_vec2_t chunk_pos)
+{
+  memset(e, 0, sizeof(*e));
+  e->c = world_get_chunk(chunk_pos);
+  e->origin = wt_vec3(chunk_pos.x * CHUNK_SIZE_X, 0, chunk_pos.y * CHUNK_SIZE_Z);
+  return e->c && e->c->status == CHUNK_STATUS_READY;
+}
+
+static void end_bulk_edit(bulk_edit_t *e)
+{
+  if (!e->blocks)
+  {
+    return;
+  }
+
+  e->c->dirty_sections |= e->sections;
+  for (usize i = 0; i < WT_ARRAY_COUNT(k_neighbors); ++i)
+  {
+    if (e->side_sections[i])
+    {
+      mark_chunk_dirty(wt_vec2i_add(e->c->position, k_neighbors[i]), e->side_sections[i]);
+    }
+  }
+}
+
+// x from x_begin to x_end in row (y, z) of the chunk
+static void bulk_fill_row(bulk_edit_t *e, i32 x_begin, i32 x_end, i32 y, i32 z, block_id_t block)
+{
+  usize row = z * CHUNK_SIZE_X + y * CHUNK_SIZE_X * CHUNK_SIZE_Z;
+  block_id_t *src = e->c->data->blocks + row;
+  i32 first = x_begin;
+  while (first < x_end && src[first] == block)
+  {
+    ++first;
+  }
+  if (first == x_end || e->failed)
+  {
+    return;
+  }
+
+  if (!e->blocks)
+  {
+    flush_chunk_save(e->c);
+    e->blocks = chunk_edit_blocks(e->c);
+    e->failed = !e->blocks;
+    if (e->failed)
+    {
+      return;
+    }
+    src = e->blocks + row;
+  }
+
+  i32 last = first;
+  for (i32 x = first; x < x_end; ++x)
+  {
+    if (src[x] != block)
+    {
+      wt_vec3_t pos = wt_vec3(e->origin.x + x, y, e->origin.z + z);
+      journal_append(pos, src[x], block);
+      tick_block_changed(pos, src[x], block);
+      fluid_block_changed(pos, src[x], block);
+      last = x;
+    }
+  }
+
+  // then the whole run at once
+  for (i32 x = first; x <= last; ++x)
+  {
+    src[x] = block;
+  }
+
+  // the light is only spread once the whole edit is in, see world_render
+  for (i32 x = first; x <= last; ++x)
+  {
+    chunk_update_heights(e->c->data, wt_vec3(x, y, z));
+    light_block_changed(wt_vec3(e->origin.x + x, y, e->origin.z + z));
+  }
+
+  u32 section = y / CHUNK_SECTION_SIZE_Y;
+  e->sections |= chunk_sections_touched(wt_vec3(first, y, z));
+
+  if (first == 0)                { e->side_sections[0] |= 1u << section; }
+  if (last == CHUNK_SIZE_X - 1)  { e->side_sections[1] |= 1u << section; }
+  if (z == 0)                    { e->side_sections[2] |= 1u << section; }
+  if (z == CHUNK_SIZE_Z - 1)     { e->side_sections[3] |= 1u << section; }
+}
+
+static bool shape_fill(i32 y, i32 z, i32 *x_begin, i32 *x_end, void *user)
+{
+  WT_UNUSED(y);
+  WT_UNUSED(z);
+  WT_UNUSED(x_begin);
+  WT_UNUSED(x_end);
+  WT_UNUSED(user);
+  return true;
+}
+
+void world_fill_region(wt_vec3_t min, wt_vec3_t max, block_id_t block)
+{
+  world_apply_shape(min, max, shape_fill, NULL, block);
+}
+
+void world_apply_shape(wt_vec3_t min, wt_vec3_t max, world_shape_row_t shape, void *user,
+  block_id_t block)
+{
+  world_state_t *s = get_state();
+  min = wt_vec3(WT_MAX(min.x, 0), WT_MAX(min.y, 0), WT_MAX(min.z, 0));
+  max = wt_vec3(WT_MIN(max.x, s->size.x * CHUNK_SIZE_X), WT_MIN(max.y, CHUNK_SIZE_Y),
+    WT_MIN(max.z, s->size.y * CHUNK_SIZE_Z));
+  if (min.x >= max.x || min.y >= max.y || min.z >= max.z)
+  {
+    return;
+  }
+
+  for (i32 cz = min.z / CHUNK_SIZE_Z; cz <= (max.z - 1) / CHUNK_SIZE_Z; ++cz)
+  {
+    for (i32 cx = min.x / CHUNK_SIZE_X; cx <= (max.x - 1) / CHUNK_SIZE_X; ++cx)
+    {
+      bulk_edit_t e;
+      if (!begin_bulk_edit(&e, wt_vec2(cx, cz)))
       {
-        s->chunks[chunk_pos.x + (chunk_pos.y - 1) * WORLD_MAX_CHUNKS_X]->dirty = true;
+        continue;
       }
-      if (block_pos.z == CHUNK_SIZE_X - 1 && chunk_pos.y < WORLD_MAX_CHUNKS_X - 1)
+
+      i32 chunk_x_begin = WT_MAX(min.x, e.origin.x);
+      i32 chunk_x_end = WT_MIN(max.x, e.origin.x + CHUNK_SIZE_X);
+      i32 z_begin = WT_MAX(min.z, e.origin.z);
+      i32 z_end = WT_MIN(max.z, e.origin.z + CHUNK_SIZE_Z);
+
+      for (i32 y = min.y; y < max.y; ++y)
       {
-        s->chunks[chunk_pos.x + (chunk_pos.y + 1) * WORLD_MAX_CHUNKS_X]->dirty = true;
+        for (i32 z = z_begin; z < z_end; ++z)
+        {
+          i32 x_begin = chunk_x_begin;
+          i32 x_end = chunk_x_end;
+          if (!shape(y, z, &x_begin, &x_end, user))
+          {
+            continue;
+          }
+          x_begin = WT_MAX(x_begin, chunk_x_begin);
+          x_end = WT_MIN(x_end, chunk_x_end);
+          if (x_begin < x_end)
+          {
+            bulk_fill_row(&e, x_begin - e.origin.x, x_end - e.origin.x, y, z - e.origin.z, block);
+          }
+        }
       }
+      end_bulk_edit(&e);
     }
   }
 }
 
-block_id_t world_get_block(wt_vec3_t pos)
+void world_set_blocks(world_edit_t *edits, usize num_edits)
 {
-  world_state_t *s = get_state();
+  mem_scratch_begin();
 
-  if (pos.x < 0 || pos.y < 0 || pos.z < 0)
+  // bucket them by chunk, keeping them in order within each chunk
+  u32 *first = mem_scratch_push((WORLD_MAX_CHUNKS + 1) * sizeof(u32));
+  memset(first, 0, (WORLD_MAX_CHUNKS + 1) * sizeof(u32));
+  for (usize i = 0; i < num_edits; ++i)
   {
-    return 0;
+    if (world_within_bounds(edits[i].pos))
+    {
+      wt_vec3_t pos = edits[i].pos;
+      first[pos.x / CHUNK_SIZE_X + (pos.z / CHUNK_SIZE_Z) * WORLD_MAX_CHUNKS_X + 1] += 1;
+    }
+  }
+  for (usize i = 0; i < WORLD_MAX_CHUNKS; ++i)
+  {
+    first[i + 1] += first[i];
   }
 
-  wt_vec2_t chunk_pos = { 0 };
-  chunk_pos.x = floorf(pos.x / CHUNK_SIZE_X);
-  chunk_pos.y = floorf(pos.z / CHUNK_SIZE_Z);
-  wt_vec3_t block_pos = { 0 };
-  block_pos.x = pos.x % CHUNK_SIZE_X;
-  block_pos.y = pos.y;
-  block_pos.z = pos.z % CHUNK_SIZE_Z;
+  u32 *cursors = mem_scratch_push(WORLD_MAX_CHUNKS * sizeof(u32));
+  memcpy(cursors, first, WORLD_MAX_CHUNKS * sizeof(u32));
+  world_edit_t *sorted = mem_scratch_push(first[WORLD_MAX_CHUNKS] * sizeof(world_edit_t));
+  for (usize i = 0; i < num_edits; ++i)
+  {
+    if (world_within_bounds(edits[i].pos))
+    {
+      wt_vec3_t pos = edits[i].pos;
+      sorted[cursors[pos.x / CHUNK_SIZE_X + (pos.z / CHUNK_SIZE_Z) * WORLD_MAX_CHUNKS_X]++] = edits[i];
+    }
+  }
 
-  if (chunk_pos.x >= 0 && chunk_pos.y >= 0 &&
-    chunk_pos.x < WORLD_MAX_CHUNKS_X && chunk_pos.y < WORLD_MAX_CHUNKS_Z)
+  for (usize i = 0; i < WORLD_MAX_CHUNKS; ++i)
   {
-    chunk_t *c = s->chunks[chunk_pos.x + chunk_pos.y * WORLD_MAX_CHUNKS_X];
-    return chunk_get_block(c, block_pos);
+    bulk_edit_t e;
+    if (first[i] == first[i + 1] ||
+      !begin_bulk_edit(&e, wt_vec2(i % WORLD_MAX_CHUNKS_X, i / WORLD_MAX_CHUNKS_X)))
+    {
+      continue;
+    }
+
+    for (u32 j = first[i]; j < first[i + 1]; ++j)
+    {
+      wt_vec3_t pos = wt_vec3i_sub(sorted[j].pos, e.origin);
+      bulk_fill_row(&e, pos.x, pos.x + 1, pos.y, pos.z, sorted[j].block);
+    }
+    end_bulk_edit(&e);
   }
-  return 0;
+
+  mem_scratch_end();
+}
+
+static chunk_t *get_column_chunk(i32 x, i32 z, usize *column)
+{
+  chunk_t *c = world_get_chunk(wt_vec2(x >> CHUNK_SHIFT_X, z >> CHUNK_SHIFT_Z));
+  *column = (x & (CHUNK_SIZE_X - 1)) | ((z & (CHUNK_SIZE_Z - 1)) << CHUNK_SHIFT_X);
+  return c && c->status == CHUNK_STATUS_READY ? c : NULL;
+}
+
+i32 world_get_height(i32 x, i32 z)
+{
+  usize column;
+  chunk_t *c = get_column_chunk(x, z, &column);
+  return c ? c->data->heights[column] : 0;
+}
+
+i32 world_get_solid_height(i32 x, i32 z)
+{
+  usize column;
+  chunk_t *c = get_column_chunk(x, z, &column);
+  return c ? c->data->solid_heights[column] : 0;
+}
+
+block_id_t world_get_block(wt_vec3_t pos)
+{
+  world_cursor_t cur = world_cursor(pos);
+  return world_cursor_get(&cur);
 }
 
 bool world_within_bounds(wt_vec3_t pos)
 {
+  world_state_t *s = get_state();
   return (pos.x >= 0 && pos.y >= 0 && pos.z >= 0 &&
-    pos.x < WORLD_MAX_CHUNKS_X * CHUNK_SIZE_X &&
+    pos.x < s->size.x * CHUNK_SIZE_X &&
     pos.y < CHUNK_SIZE_Y &&
-    pos.z < WORLD_MAX_CHUNKS_Z * CHUNK_SIZE_Z);
+    pos.z < s->size.y * CHUNK_SIZE_Z);
 }
 
-world_raycast_t world_raycast(int max_num_blocks)
+// chunks that are still loading read as missing, their load job is still writing the blocks
+static chunk_t *cursor_chunk(i32 x, i32 z)
+{
+  usize column;
+  return get_column_chunk(x, z, &column);
+}
+
+world_cursor_t world_cursor(wt_vec3_t pos)
+{
+  world_cursor_t cur = { 0 };
+  cur.pos = pos;
+  cur.chunk = cursor_chunk(pos.x, pos.z);
+  return cur;
+}
+
+void world_cursor_step_x(world_cursor_t *cur, i32 step)
+{
+  i32 x = cur->pos.x + step;
+  if ((x >> CHUNK_SHIFT_X) != (cur->pos.x >> CHUNK_SHIFT_X))
+  {
+    cur->chunk = cursor_chunk(x, cur->pos.z);
+  }
+  cur->pos.x = x;
+}
+
+void world_cursor_step_y(world_cursor_t *cur, i32 step)
+{
+  // chunks go all the way up, world_cursor_get checks y
+  cur->pos.y += step;
+}
+
+void world_cursor_step_z(world_cursor_t *cur, i32 step)
+{
+  i32 z = cur->pos.z + step;
+  if ((z >> CHUNK_SHIFT_Z) != (cur->pos.z >> CHUNK_SHIFT_Z))
+  {
+    cur->chunk = cursor_chunk(cur->pos.x, z);
+  }
+  cur->pos.z = z;
+}
+
+block_id_t world_cursor_get(world_cursor_t *cur)
+{
+  if (!cur->chunk || (u32)cur->pos.y >= CHUNK_SIZE_Y)
+  {
+    return 0;
+  }
+
+  usize offset = (cur->pos.x & (CHUNK_SIZE_X - 1)) |
+    ((cur->pos.z & (CHUNK_SIZE_Z - 1)) << CHUNK_SHIFT_X) |
+    (cur->pos.y << (CHUNK_SHIFT_X + CHUNK_SHIFT_Z));
+  return cur->chunk->data->blocks[offset];
+}
+
+static world_raycast_t raycast_from(wt_vec3f_t player_pos, wt_vec2f_t player_rot, int max_num_blocks)
 {
-  wt_vec3f_t player_pos = player_get_head_position();
-  wt_vec2f_t player_rot = player_get_rotation();
-  wt_vec3i_t map_pos = wt_vec3f_to_vec3i(player_pos);
+  wt_vec3i_t start = wt_vec3f_to_vec3i(player_pos);
+  world_cursor_t cur = world_cursor(start);
+  wt_vec3i_t map_pos = start;
 
   f32 yc = cosf(player_rot.y * WT_TAU_F32);
   f32 ys = sinf(player_rot.y * WT_TAU_F32);
@@ -242,21 +1598,22 @@ world_raycast_t world_raycast(int max_num_blocks)
     if (side_dist_x < side_dist_z && side_dist_x < side_dist_y)
     {
       side_dist_x += delta_dist_x;
-      map_pos.x += step_x;
+      world_cursor_step_x(&cur, step_x);
     }
     else if (side_dist_y < side_dist_x && side_dist_y < side_dist_z)
     {
       side_dist_y += delta_dist_y;
-      map_pos.y += step_y;
+      world_cursor_step_y(&cur, step_y);
     }
     else
     {
       side_dist_z += delta_dist_z;
-      map_pos.z += step_z;
+      world_cursor_step_z(&cur, step_z);
     }
+    map_pos = cur.pos;
 
     // make sure we haven't hit the distance cap
-    wt_vec3i_t diff = wt_vec3i_sub(map_pos, wt_vec3f_to_vec3i(player_pos));
+    wt_vec3i_t diff = wt_vec3i_sub(map_pos, start);
     diff.x = abs(diff.x);
     diff.y = abs(diff.y);
     diff.z = abs(diff.z);
@@ -266,7 +1623,7 @@ world_raycast_t world_raycast(int max_num_blocks)
     }
 
     // check for hits
-    block_id_t block = world_get_block(map_pos);
+    block_id_t block = world_cursor_get(&cur);
     if (block != 0)
     {
       hit = true;
@@ -290,3 +1647,127 @@ world_raycast_t world_raycast(int max_num_blocks)
 
   return raycast;
 }
+
+world_raycast_t world_raycast(int max_num_blocks)
+{
+  return raycast_from(player_get_head_position(), player_get_rotation(), max_num_blocks);
+}
+
+// the blocks a player sized box at pos overlaps, read the way player collision does
+static u32 read_box(wt_vec3f_t pos, bool use_cursor)
+{
+  i32 minx = floorf(pos.x - PLAYER_RADIUS), maxx = ceilf(pos.x + PLAYER_RADIUS);
+  i32 miny = floorf(pos.y),                 maxy = ceilf(pos.y + PLAYER_HEIGHT);
+  i32 minz = floorf(pos.z - PLAYER_RADIUS), maxz = ceilf(pos.z + PLAYER_RADIUS);
+
+  u32 res = 0;
+  for (i32 y = miny; y < maxy; ++y)
+  {
+    for (i32 z = minz; z < maxz; ++z)
+    {
+      world_cursor_t cur = world_cursor(wt_vec3(minx, y, z));
+      for (i32 x = minx; x < maxx; ++x)
+      {
+        if (use_cursor)
+        {
+          res += world_cursor_get(&cur);
+          world_cursor_step_x(&cur, 1);
+        }
+        else
+        {
+          res += world_get_block(wt_vec3(x, y, z));
+        }
+      }
+    }
+  }
+  return res;
+}
+
+void world_dbg_benchmark(void)
+{
+  wt_vec3f_t head = player_get_head_position();
+  f64 freq = (f64)sys_get_performance_frequency();
+  game_dbg_print("world benchmark around (%.0f %.0f %.0f)", head.x, head.y, head.z);
+
+  // rays spread over every direction
+  u64 begin = sys_get_performance_counter();
+  usize num_hits = 0;
+  for (usize i = 0; i < WORLD_BENCHMARK_RAYS; ++i)
+  {
+    wt_vec2f_t rot = wt_vec2f((f32)i / WORLD_BENCHMARK_RAYS, (f32)(i % 257) / 257.0f - 0.5f);
+    num_hits += raycast_from(head, rot, 64).hit;
+  }
+  u64 end = sys_get_performance_counter();
+  game_dbg_print("  raycast         %8.1f ns/ray (%zu of %d hit)",
+    (f64)(end - begin) / freq * 1e9 / WORLD_BENCHMARK_RAYS, num_hits, WORLD_BENCHMARK_RAYS);
+
+  mem_scratch_begin();
+  wt_vec3f_t *boxes = mem_scratch_push(WORLD_BENCHMARK_BOXES * sizeof(wt_vec3f_t));
+  for (usize i = 0; i < WORLD_BENCHMARK_BOXES; ++i)
+  {
+    boxes[i] = wt_vec3f_add(head, wt_vec3f(rng_next_range(-4000, 4000) / 100.0f,
+      rng_next_range(-4000, 4000) / 100.0f, rng_next_range(-4000, 4000) / 100.0f));
+  }
+
+  // collision reads a handful of blocks at a time
+  u32 sums[2] = { 0 };
+  for (usize mode = 0; mode < 2; ++mode)
+  {
+    begin = sys_get_performance_counter();
+    for (usize i = 0; i < WORLD_BENCHMARK_BOXES; ++i)
+    {
+      sums[mode] += read_box(boxes[i], mode == 1);
+    }
+    end = sys_get_performance_counter();
+    game_dbg_print("  collision %-6s %8.1f ns/box", mode == 1 ? "cursor" : "get",
+      (f64)(end - begin) / freq * 1e9 / WORLD_BENCHMARK_BOXES);
+  }
+
+  // a random walk, like a ray that keeps turning
+  u8 *axes = mem_scratch_push(WORLD_BENCHMARK_STEPS);
+  for (usize i = 0; i < WORLD_BENCHMARK_STEPS; ++i)
+  {
+    axes[i] = rng_next_range(0, 6);
+  }
+
+  u32 walk_sums[2] = { 0 };
+  for (usize mode = 0; mode < 2; ++mode)
+  {
+    world_cursor_t cur = world_cursor(wt_vec3f_to_vec3i(head));
+    wt_vec3_t pos = cur.pos;
+    begin = sys_get_performance_counter();
+    for (usize i = 0; i < WORLD_BENCHMARK_STEPS; ++i)
+    {
+      i32 step = (axes[i] & 1) ? 1 : -1;
+      if (mode == 1)
+      {
+        switch (axes[i] >> 1)
+        {
+          case 0:  world_cursor_step_x(&cur, step); break;
+          case 1:  world_cursor_step_y(&cur, step); break;
+          default: world_cursor_step_z(&cur, step); break;
+        }
+        walk_sums[mode] += world_cursor_get(&cur);
+      }
+      else
+      {
+        switch (axes[i] >> 1)
+        {
+          case 0:  pos.x += step; break;
+          case 1:  pos.y += step; break;
+          default: pos.z += step; break;
+        }
+        walk_sums[mode] += world_get_block(pos);
+      }
+    }
+    end = sys_get_performance_counter();
+    game_dbg_print("  walk %-11s %8.1f ns/step", mode == 1 ? "cursor" : "get",
+      (f64)(end - begin) / freq * 1e9 / WORLD_BENCHMARK_STEPS);
+  }
+  mem_scratch_end();
+
+  if (sums[0] != sums[1] || walk_sums[0] != walk_sums[1])
+  {
+    game_dbg_print("  cursor reads don't match world_get_block!");
+  }
+}
@@ -3,11 +3,27 @@
 
 #include <wt/wt.h>
 #include "block.h"
+#include "chunk.h"
 
+// worlds can be any size up to this, new ones get the whole thing
 #define WORLD_MAX_CHUNKS_X 64
 #define WORLD_MAX_CHUNKS_Z 64
 #define WORLD_MAX_CHUNKS (WORLD_MAX_CHUNKS_X * WORLD_MAX_CHUNKS_Z)
 
+// the world header, older worlds stored every chunk in here instead
+#define WORLD_FILENAME "test.world"
+
+// new worlds get this one, it's the ground there was before worlds had seeds (see chunk.c)
+#define WORLD_DEFAULT_SEED 0
+
+// the player spawns in the far corner chunk, which always stays loaded
+#define WORLD_SPAWN_RADIUS 2
+
+#define WORLD_MAX_TICKETS 64
+
+// a ticket keeps every chunk within `radius` chunks of its position loaded
+typedef i32 world_ticket_t;
+
 typedef struct
 {
   wt_vec3_t pos;
@@ -18,19 +34,75 @@ typedef struct
   bool hit;
 } world_raycast_t;
 
+typedef struct
+{
+  wt_vec3_t pos;
+  block_id_t block;
+} world_edit_t;
+
+// reads blocks while walking the world a block at a time. the chunk is only looked up again when
+// the cursor crosses into another one. main thread only, like world_get_block
+typedef struct
+{
+  wt_vec3_t pos;
+  chunk_t *chunk; // NULL if pos isn't in a ready chunk
+} world_cursor_t;
+
+// shapes are handed to world_apply_shape a row of blocks at a time. it sets the x range
+// [*x_begin, *x_end) of row (y, z) the shape covers, or returns false if it covers none of it
+typedef bool (*world_shape_row_t)(i32 y, i32 z, i32 *x_begin, i32 *x_end, void *user);
+
 void            world_init(void);
 void            world_tick(void);
 void            world_render(void);
-void            world_generate(void);
+// throws the world away and starts over from a new seed
+void            world_generate(u32 seed);
 
+// saving happens in the background over the next few ticks, world_save_wait blocks until it's done
 void            world_save(void);
+void            world_save_wait(void);
 bool            world_load(void);
 
+wt_vec2_t       world_get_size(void); // in chunks
+wt_vec2_t       world_get_spawn_chunk(void);
+u32             world_get_seed(void);
+
 void            world_dbg_rebuild_meshes(void);
+// times raycasts and collision sized block reads around the player, see game_dbg_print
+void            world_dbg_benchmark(void);
+
+world_ticket_t  world_ticket_add(wt_vec2_t chunk_pos, i32 radius);
+void            world_ticket_move(world_ticket_t ticket, wt_vec2_t chunk_pos);
+void            world_ticket_remove(world_ticket_t ticket);
+
+// NULL if the chunk isn't resident
+chunk_t        *world_get_chunk(wt_vec2_t chunk_pos);
+// the ready chunks within a ticket, which are the ones blocks tick in. returns how many there are
+usize           world_get_ticking_chunks(chunk_t **chunks, usize max);
 
 void            world_set_block(wt_vec3_t pos, block_id_t block);
 block_id_t      world_get_block(wt_vec3_t pos);
 bool            world_within_bounds(wt_vec3_t pos);
+// one above the highest block in the column (that isn't air, or that's solid). 0 if there's
+// nothing there or its chunk isn't loaded yet
+i32             world_get_height(i32 x, i32 z);
+i32             world_get_solid_height(i32 x, i32 z);
+
+world_cursor_t  world_cursor(wt_vec3_t pos);
+// steps are -1 or +1
+void            world_cursor_step_x(world_cursor_t *cur, i32 step);
+void            world_cursor_step_y(world_cursor_t *cur, i32 step);
+void            world_cursor_step_z(world_cursor_t *cur, i32 step);
+// air outside the world and in chunks that aren't ready
+block_id_t      world_cursor_get(world_cursor_t *cur);
+
+// bulk edits go chunk by chunk, each chunk (and each neighbor that sees a change) is marked dirty
+// once. every changed block is still journaled. blocks in chunks that aren't loaded are dropped
+void            world_fill_region(wt_vec3_t min, wt_vec3_t max, block_id_t block); // max is exclusive
+void            world_apply_shape(wt_vec3_t min, wt_vec3_t max, world_shape_row_t shape, void *user,
+                  block_id_t block);
+// edits to the same block are applied in the order given
+void            world_set_blocks(world_edit_t *edits, usize num_edits);
 
 world_raycast_t world_raycast(int max_num_blocks);
 